@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+uint32_t adler32(const uint8_t* data, size_t size, uint32_t adler = 1);
+uint32_t adler32_combine(uint32_t first_adler, uint32_t second_adler, size_t second_size);
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+
+struct deflated_data
+{
+    std::vector<uint8_t> bytes;
+    uint32_t adler;
+};
+
+// Compresses chunks of the data independently on separate threads. Each chunk ends byte-aligned,
+// so the results of consecutive calls concatenate into a single deflate stream as long as only
+// the last call is final.
+deflated_data deflate_parallel(const uint8_t* data, size_t size, bool is_final, uint32_t thread_count);
+
+std::vector<uint8_t> zlib_compress(const uint8_t* data, size_t size, uint32_t thread_count);
\ No newline at end of file
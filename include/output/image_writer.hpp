@@ -0,0 +1,73 @@
+#pragma once
+
+#include <util/colors.hpp>
+#include <util/sizes.hpp>
+
+#include <array>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class image_format
+{
+    jpg,
+    png,
+    ppm,
+    qoi,
+};
+
+image_format image_format_of(std::string_view path);
+
+// Writes an image to a file in bands of rows, top to bottom. PNG bands are filtered and compressed
+// on all threads, PPM and QOI are fast formats meant for intermediate frames.
+class image_writer
+{
+public:
+    image_writer(std::string_view path, const extent_2D<uint32_t>& image_size, uint32_t thread_count);
+    void write_rows(const rgba* rows, uint32_t row_count);
+    void finish();
+
+private:
+    void check_file() const;
+
+    void write_png_header();
+    void write_png_chunk(const char (&type)[5], const uint8_t* data, size_t size);
+    void write_png_rows(const rgba* rows, uint32_t row_count);
+    void finish_png();
+
+    void write_ppm_header();
+    void write_ppm_rows(const rgba* rows, uint32_t row_count);
+
+    void write_qoi_header();
+    void write_qoi_rows(const rgba* rows, uint32_t row_count);
+    void finish_qoi();
+
+private:
+    const std::string path;
+    const image_format format;
+    const extent_2D<uint32_t> image_size;
+    const uint32_t thread_count;
+
+    std::ofstream file;
+    uint32_t written_row_count = 0;
+
+    struct
+    {
+        std::vector<uint8_t> previous_row;
+        uint32_t adler = 1;
+    } png;
+
+    struct
+    {
+        rgba previous = rgba{ 0, 0, 0, 255 };
+        std::array<rgba, 64> seen = {};
+        uint32_t run = 0;
+    } qoi;
+
+    // The JPEG encoder cannot take the image in parts.
+    std::vector<rgba> jpg_rows;
+};
+
+void export_image(const std::vector<rgba>& image, const extent_2D<uint32_t>& image_size, std::string_view path,
+    uint32_t thread_count);
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <render_objects/camera.hpp>
+#include <util/pairs.hpp>
+
+#include <functional>
+
+struct animation_frame
+{
+    uint32_t index;
+    min_max<float> time;
+};
+
+enum class scene_changes
+{
+    nothing,
+    appearance,
+    geometry,
+};
+
+struct animation
+{
+    uint32_t frame_count = 0;
+    float frame_rate = 24.f;
+    float shutter = 0.5f;
+
+    // The returned camera's time interval is overwritten with the frame's shutter interval.
+    std::function<camera_create_info(const animation_frame&)> animate_camera;
+
+    // Only a change in geometry makes the hierarchy get updated before rendering the frame.
+    std::function<scene_changes(struct scene&, const animation_frame&)> animate_scene;
+
+    animation_frame frame(uint32_t index) const;
+    bool is_empty() const;
+};
\ No newline at end of file
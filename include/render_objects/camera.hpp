@@ -24,7 +24,9 @@ struct camera
     displacement_3D u;
     displacement_3D v;
     float lens_radius;
+    float vertical_fov;
     min_max<float> time;
 
+    camera() = default;
     camera(const camera_create_info&);
 };
\ No newline at end of file
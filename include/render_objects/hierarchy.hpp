@@ -1,11 +1,19 @@
 #pragma once
 
 #include <render_objects/shapes.hpp>
+#include <util/mapped_array.hpp>
 
+#include <atomic>
+#include <memory>
 #include <vector>
 
 enum class BIH_node_type : uint32_t { x, y, z, leaf };
 
+struct BIH_clip
+{
+    float left, right;
+};
+
 struct BIH_node
 {
     BIH_node_type type;
@@ -14,12 +22,85 @@ struct BIH_node
         struct { uint32_t index, count; } shape_group;
         struct
         {
-            struct { float left, right; } clip;
+            BIH_clip clip;
             struct { uint32_t left, right; } children;
         };
     };
 };
 
-using bounding_interval_hierarchy = std::vector<BIH_node>;
+using bounding_interval_hierarchy = aligned_array<BIH_node>;
+// Clip planes of the nodes at the end of the scene's motion interval, by node index. The nodes hold
+// the ones at the start, and rays interpolate between the two at their time.
+using BIH_end_clips = aligned_array<BIH_clip>;
+
+bounding_interval_hierarchy make_hierarchy(aligned_array<shape>& in_shapes);
+
+// Quantized meshes have a hierarchy of their own, whose leaves hold a few triangles, since a node takes
+// more memory than a quantized triangle. It is built over the decoded positions and reorders the
+// triangles; the scene only holds one shape for the whole mesh.
+static constexpr uint32_t quantized_mesh_leaf_size = 4;
+bounding_interval_hierarchy make_hierarchy(quantized_mesh_triangle_shape* triangles, size_t count,
+    const quantized_mesh&, const quantized_vertex* vertices);
+
+struct hierarchy_refit
+{
+    axis_aligned_box bounds;
+    // Expected cost of a ray through the hierarchy, node visits and shape tests weighted by the
+    // surface area of the nodes relative to the whole hierarchy.
+    float cost;
+    // Shapes from here on were added after the hierarchy was built.
+    size_t covered_shape_count;
+};
+
+// Moves the clip planes of every node to the current bounding boxes of the shapes below it, on all
+// threads. Removed shapes, which have no type, are skipped.
+hierarchy_refit refit_hierarchy(bounding_interval_hierarchy&, const aligned_array<shape>&, uint32_t thread_count);
+// Refits to the bounding boxes of the shapes at the start and at the end of their motion, given in
+// the order of the shapes. The planes move linearly in between, so for shapes whose corners move
+// linearly they still bound them at any time. The cost is the mean of the costs at both ends.
+hierarchy_refit refit_hierarchy(bounding_interval_hierarchy&, BIH_end_clips&, const aligned_array<shape>&,
+    const std::vector<min_max<axis_aligned_box>>& motion_bounding_boxes, uint32_t thread_count);
+// Puts the shapes added after the hierarchy was built in a leaf under a new root, next to the old
+// root. The clip planes are left to the next refit.
+void insert_into_hierarchy(bounding_interval_hierarchy&, const aligned_array<shape>&, const hierarchy_refit&);
+
+// A hierarchy whose nodes are split the first time a ray reaches them, so building it only costs as
+// much as the part of the scene that is seen. Threads reaching a node while another one splits it
+// wait for the split. Splitting reorders the shapes under the node, so the shapes cannot be added to
+// or changed while the hierarchy is in use.
+class lazy_BIH
+{
+public:
+    explicit lazy_BIH(aligned_array<shape>& shapes);
+
+    bool empty() const { return this->nodes.empty(); }
+    const BIH_node& node(uint32_t index)
+    {
+        if (this->states[index].load(std::memory_order_acquire) != node_state::expanded)
+        {
+            this->expand(index);
+        }
+        return this->nodes[index];
+    }
+
+    // Splits every node left and returns the whole hierarchy.
+    bounding_interval_hierarchy expand_all();
+    size_t expanded_node_count() const { return this->empty() ? 0 : this->node_count.load(); }
+    size_t node_capacity() const { return this->nodes.size(); }
+    // Bytes of every node, whether it is expanded yet or not.
+    static constexpr size_t node_size = sizeof(BIH_node) + sizeof(axis_aligned_box) + sizeof(std::atomic<uint8_t>);
+
+private:
+    enum node_state : uint8_t { unexpanded, expanding, expanded };
+
+    void expand(uint32_t index);
+
+private:
+    shape* shapes;
+    std::vector<BIH_node, aligned_allocator<BIH_node>> nodes;
+    std::vector<axis_aligned_box> node_bounds;
+    std::unique_ptr<std::atomic<uint8_t>[]> states;
+    std::atomic<uint32_t> node_count = 1;
+};
 
-bounding_interval_hierarchy make_hierarchy(std::vector<shape>& in_shapes);
\ No newline at end of file
+std::shared_ptr<lazy_BIH> make_lazy_hierarchy(aligned_array<shape>& in_shapes);
\ No newline at end of file
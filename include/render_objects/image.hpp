@@ -1,17 +1,190 @@
 #pragma once
 
 #include <util/barycentric.hpp>
+#include <util/byte_buffer.hpp>
 #include <util/colors.hpp>
+#include <util/packing.hpp>
 #include <util/pairs.hpp>
 #include <util/sizes.hpp>
 #include <util/vector.hpp>
 
+#include <cstring>
 #include <vector>
 
+enum class texel_format
+{
+    rgb8,
+    normal_oct16,
+    rgb16f,
+    rgb32f,
+};
+
+inline static constexpr size_t texel_size(const texel_format in_format)
+{
+    switch (in_format)
+    {
+        case texel_format::rgb8:         return 3 * sizeof(uint8_t);
+        case texel_format::normal_oct16: return sizeof(uint16_t);
+        case texel_format::rgb16f:       return 3 * sizeof(uint16_t);
+        case texel_format::rgb32f:       return 3 * sizeof(float);
+    }
+    return 0;
+}
+
+enum class texel_layout
+{
+    linear,
+    // Blocks of 4x4 texels are stored contiguously, so a filter footprint touches a few cache lines
+    // instead of one per row. A block takes 32 to 192 bytes, from normal_oct16 to rgb32f.
+    tiled_4x4,
+};
+
+struct mip_level
+{
+    extent_2D<uint32_t> size;
+    size_t first_texel;
+};
+
+// Texels stay in their storage format and are decoded to vectors when sampled.
+// All mip levels share the texel buffer, the full resolution comes first.
 struct vector_map
 {
     extent_2D<uint32_t> size;
-    std::vector<glm::vec3> pixels;
+    texel_format format;
+    texel_layout layout;
+    byte_buffer texels;
+    std::vector<mip_level> levels;
+
+    static vector_map allocate(const extent_2D<uint32_t>& in_size, const texel_format in_format)
+    {
+        return vector_map{
+            in_size,
+            in_format,
+            texel_layout::linear,
+            byte_buffer(size_t(in_size.width) * in_size.height * texel_size(in_format)),
+            { mip_level{ in_size, 0 } },
+        };
+    }
+
+    void generate_mip_levels();
+    void set_layout(texel_layout);
+    bool page_texels(std::shared_ptr<page_cache>);
+    // Whether the levels follow each other through the whole texel buffer, as generated. Maps read
+    // back from files are checked before their texels are used.
+    bool has_consistent_levels() const;
+
+    template <texel_layout L>
+    static size_t texel_index_in(const mip_level& in_level, const uint32_t in_x, const uint32_t in_y)
+    {
+        if constexpr (L == texel_layout::tiled_4x4)
+        {
+            const uint32_t tiles_per_row = (in_level.size.width + 3) / 4;
+            const size_t tile = ((in_y / 4) * tiles_per_row) + (in_x / 4);
+            return in_level.first_texel + (tile * 16) + ((in_y % 4) * 4) + (in_x % 4);
+        }
+        else
+        {
+            return in_level.first_texel + in_x + (size_t(in_y) * in_level.size.width);
+        }
+    }
+
+    size_t texel_index(const mip_level& in_level, const uint32_t in_x, const uint32_t in_y) const
+    {
+        if (this->layout == texel_layout::tiled_4x4)
+        {
+            return texel_index_in<texel_layout::tiled_4x4>(in_level, in_x, in_y);
+        }
+        return texel_index_in<texel_layout::linear>(in_level, in_x, in_y);
+    }
+
+    template <texel_format F>
+    static glm::vec3 decode_texel(const uint8_t* in_data)
+    {
+        if constexpr (F == texel_format::rgb8)
+        {
+            constexpr float normalized_rgb = 1.f / 255.f;
+            return glm::vec3{ float(in_data[0]), float(in_data[1]), float(in_data[2]) } * normalized_rgb;
+        }
+        else if constexpr (F == texel_format::normal_oct16)
+        {
+            uint16_t packed;
+            std::memcpy(&packed, in_data, sizeof(packed));
+            return unpack_octahedral_16(packed);
+        }
+        else if constexpr (F == texel_format::rgb16f)
+        {
+            uint16_t packed[3];
+            std::memcpy(packed, in_data, sizeof(packed));
+            return unpack_half_3(packed);
+        }
+        else
+        {
+            glm::vec3 value;
+            std::memcpy(&value, in_data, sizeof(value));
+            return value;
+        }
+    }
+
+    glm::vec3 texel(const mip_level& in_level, const uint32_t in_x, const uint32_t in_y) const
+    {
+        return this->texel(this->texel_index(in_level, in_x, in_y));
+    }
+
+    glm::vec3 texel(const size_t in_index) const
+    {
+        uint8_t scratch[3 * sizeof(float)];
+        const size_t size = texel_size(this->format);
+        const uint8_t* data = this->texels.bytes_at(in_index * size, size, scratch);
+        switch (this->format)
+        {
+            case texel_format::rgb8:         return decode_texel<texel_format::rgb8>(data);
+            case texel_format::normal_oct16: return decode_texel<texel_format::normal_oct16>(data);
+            case texel_format::rgb16f:       return decode_texel<texel_format::rgb16f>(data);
+            case texel_format::rgb32f:       return decode_texel<texel_format::rgb32f>(data);
+        }
+        return glm::vec3{ 0.f };
+    }
+
+    // Reads a texel of a map whose format and layout are known at compile time.
+    template <texel_format F, texel_layout L>
+    glm::vec3 texel_in(const mip_level& in_level, const uint32_t in_x, const uint32_t in_y) const
+    {
+        constexpr size_t size = texel_size(F);
+        uint8_t scratch[size];
+        return decode_texel<F>(this->texels.bytes_at(texel_index_in<L>(in_level, in_x, in_y) * size, size, scratch));
+    }
+
+    void set_texel(const size_t in_index, const glm::vec3& in_value)
+    {
+        uint8_t* data = this->texels.data() + (in_index * texel_size(this->format));
+        switch (this->format)
+        {
+            case texel_format::rgb8:
+            {
+                const rgb value = to_rgb(in_value);
+                std::memcpy(data, &value, 3);
+                break;
+            }
+            case texel_format::normal_oct16:
+            {
+                const uint16_t packed = pack_octahedral_16(in_value);
+                std::memcpy(data, &packed, sizeof(packed));
+                break;
+            }
+            case texel_format::rgb16f:
+            {
+                uint16_t packed[3];
+                pack_half_3(in_value, packed);
+                std::memcpy(data, packed, sizeof(packed));
+                break;
+            }
+            case texel_format::rgb32f:
+            {
+                std::memcpy(data, &in_value, sizeof(in_value));
+                break;
+            }
+        }
+    }
 };
 
 enum class wrap_method
@@ -22,22 +195,29 @@ enum class wrap_method
     repeat,
 };
 
+// The stochastic methods read a single texel picked by its filter weight, they converge to the
+// filtered value over many samples.
 enum class filtering_method
 {
     catrom,
     linear,
     nearest,
+    stochastic_catrom,
+    stochastic_linear,
 };
 
 using image = vector_map;
 using normal_map = vector_map;
 
-#define FILTER_ARGS \
-    const vector_map&, \
-    const min_max<texture_position_2D>& map_fragment, \
-    const barycentric_2D& mapping, \
-    wrap_method
-glm::vec3 filter_catrom(FILTER_ARGS);
-glm::vec3 filter_linear(FILTER_ARGS);
-glm::vec3 filter_nearest(FILTER_ARGS);
-#undef FILTER_ARGS
\ No newline at end of file
+// Sampling functions are specialized for every filtering and wrap method, a texture picks its sampler
+// once by index. They are also specialized for every texel format and layout, which the map picks.
+using sampler_function = glm::vec3 (*)(const vector_map&, uint32_t level,
+    const min_max<texture_position_2D>& map_fragment, const barycentric_2D& mapping);
+
+// The last mip level a fragment is sampled from, fragments of texture atlases must not shrink below a
+// texel or they would bleed into each other.
+uint32_t last_level_of_fragment(const min_max<texture_position_2D>& map_fragment);
+
+uint32_t sampler_index(filtering_method, wrap_method, const min_max<texture_position_2D>& map_fragment,
+    const extent_2D<uint32_t>& map_size);
+sampler_function sampler_at(uint32_t sampler_index, const vector_map&);
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+struct scene;
+
+// Memory of one part of a scene. Owned bytes are on the heap, with the unused capacity beyond them
+// counted apart. Mapped bytes are read from a file in place, paged bytes through a page cache.
+struct memory_usage
+{
+    std::string name;
+    size_t count = 0;
+    size_t owned_bytes = 0;
+    size_t capacity_bytes = 0;
+    size_t mapped_bytes = 0;
+    size_t paged_bytes = 0;
+
+    void add(const memory_usage&);
+};
+
+struct memory_report
+{
+    std::vector<memory_usage> parts;
+    // What the page cache of paged images holds, and may hold, on the heap.
+    size_t texture_page_bytes = 0;
+    size_t texture_page_budget = 0;
+
+    memory_usage total() const;
+    void print(std::ostream&) const;
+    std::string to_json() const;
+};
+
+memory_report report_memory(const scene&);
\ No newline at end of file
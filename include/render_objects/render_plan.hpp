@@ -1,17 +1,24 @@
 #pragma once
 
+#include <render_objects/animation.hpp>
 #include <render_objects/camera.hpp>
 #include <render_objects/scene.hpp>
 #include <util/sizes.hpp>
 
+#include <filesystem>
+
 struct render_plan
 {
     extent_2D<uint32_t> image_size;
     camera cam;
     scene world;
+    animation anim;
 
-    static render_plan test_scene(const extent_2D<uint32_t>& image_size);
+    // Scenes with images cache them in texture_cache_directory when it is set, see scene::page_textures.
+    static render_plan test_scene(const extent_2D<uint32_t>& image_size, const std::filesystem::path& texture_cache_directory = {});
     static render_plan cornell_box(const extent_2D<uint32_t>& image_size);
-    static render_plan grass_block(const extent_2D<uint32_t>& image_size);
-    static render_plan bunny(const extent_2D<uint32_t>& image_size);
+    static render_plan grass_block(const extent_2D<uint32_t>& image_size, const std::filesystem::path& texture_cache_directory = {});
+    static render_plan bunny(const extent_2D<uint32_t>& image_size, const std::filesystem::path& texture_cache_directory = {});
+    static render_plan grass_block_turntable(const extent_2D<uint32_t>& image_size,
+        const std::filesystem::path& texture_cache_directory = {});
 };
\ No newline at end of file
@@ -6,47 +6,127 @@
 #include <render_objects/shape_assembly.hpp>
 #include <render_objects/shapes.hpp>
 #include <render_objects/textures.hpp>
+#include <util/mapped_array.hpp>
 
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+// Image files already requested by a scene, and the ones still to be decoded.
+struct asset_requests
+{
+    std::unordered_map<std::string, uint32_t> by_path;
+    std::unordered_map<uint64_t, uint32_t> by_content;
+    std::vector<std::pair<uint32_t, std::function<vector_map()>>> to_decode;
+};
+
 struct scene
 {
     texture sky;
     bounding_interval_hierarchy hierarchy;
+    // Only filled in when shapes move, see refit_hierarchy.
+    BIH_end_clips hierarchy_end_clips;
+    // Used instead of the hierarchy when set, see lazy_BIH. Its nodes bound the whole motion of
+    // moving shapes.
+    std::shared_ptr<lazy_BIH> lazy_hierarchy;
+
+    // Builds the hierarchy over all shapes at their current positions, dropping removed ones.
+    void build_hierarchy();
+    // Catches the hierarchy up with shapes that moved, were added or were removed since it was built:
+    // the bounding boxes and clip planes are refitted and added shapes go under a new root. Once that
+    // makes traversal cost more than the threshold times what it did after building, it is rebuilt.
+    void update_hierarchy();
+    float hierarchy_rebuild_threshold = 1.5f;
+    float hierarchy_built_cost = 0.f;
 
     std::vector<uint8_t> to_bytes() const;
+    // Bytes of all shapes, materials, textures and images, see report_memory for a breakdown.
     size_t size() const;
 
     // Shapes
 
-    std::vector<shape> infinite_shapes;
-    std::vector<shape> shapes;
-    std::vector<sphere_shape> sphere_shapes;
-    std::vector<plane_shape> plane_shapes;
-    std::vector<triangle_shape> triangle_shapes;
+    mapped_array<shape> infinite_shapes;
+    aligned_array<shape> shapes;
+    mapped_array<sphere_shape> sphere_shapes;
+    mapped_array<plane_shape> plane_shapes;
+    aligned_array<triangle_shape> triangle_shapes;
+    aligned_array<mesh_triangle_shape> mesh_triangle_shapes;
+
+    // Vertex attributes of all meshes, the positions are read when intersecting and the rest only
+    // for the closest hit.
+    aligned_array<position_3D> mesh_positions;
+    mapped_array<direction_3D> mesh_normals;
+    mapped_array<barycentric_2D> mesh_mappings;
+
+    aligned_array<quantized_mesh_triangle_shape> quantized_mesh_triangle_shapes;
+    aligned_array<quantized_vertex> quantized_mesh_vertices;
+    mapped_array<quantized_mesh> quantized_meshes;
+    bounding_interval_hierarchy quantized_mesh_hierarchies;
+
+    // Moving shapes are at their start at the beginning of this time interval and at their end at
+    // the end of it, and in between at the time of each ray.
+    min_max<float> motion_time = { 0.f, 1.f };
+    mapped_array<moving_sphere_shape> moving_sphere_shapes;
+    // Positions at the end of the motion of all mesh vertices, once any of them move. The normals stay
+    // those at the start.
+    aligned_array<position_3D> mesh_end_positions;
+
+    bool has_motion() const;
+    // Fraction of the motion interval at a time, clamped to it.
+    float motion_at(float time) const;
 
     shape add_plane_shape(const plane_shape&, const material&);
     shape add_plane_shape(const plane&, const material&);
 
     shape add_sphere_shape(const sphere_shape&, const material&);
     shape add_sphere_shape(const sphere&, const direction_3D& axial_tilt, const material&);
+    void update_sphere_shape(array_index, const sphere_shape&);
+    shape add_moving_sphere_shape(const moving_sphere_shape&, const material&);
+    void update_moving_sphere_shape(array_index, const moving_sphere_shape&);
     
     shape add_triangle_shape(const triangle_shape&, const material&);
     shape add_triangle_shape(const triangle&, const std::array<direction_3D, 3>& normals,
         const std::array<barycentric_2D, 3>& texture_mappings, const material&);
     shape add_triangle_shape(const triangle&, const direction_3D& normal,
         const std::array<barycentric_2D, 3>& texture_mappings, const material&);
+    void update_triangle_shape(array_index, const triangle_shape&);
+
+    // Rigidly moves vertices of indexed meshes, along with their motion, see update_hierarchy.
+    void transform_mesh_vertices(size_t first_vertex, size_t count, const glm::quat& rotation,
+        const displacement_3D& translation);
+    // Makes vertices of indexed meshes move in a straight line from where they are to where the end
+    // rotation and translation put them, and the triangles using them moving mesh triangles.
+    void set_mesh_vertex_motion(size_t first_vertex, size_t count, const glm::quat& end_rotation,
+        const displacement_3D& end_translation);
+    // The shape loses its type so it is never hit, and is dropped when the hierarchy is rebuilt.
+    void remove_shape(shape_type, array_index);
+    // Moving shapes are bounded over their whole motion.
+    axis_aligned_box bounding_box_of(const shape&) const;
+    min_max<axis_aligned_box> motion_bounding_boxes_of(const shape&) const;
+    void update_bounding_boxes();
     
     void assemble_quad(const quad_assembly_info&);
     void assemble_cuboid(const cuboid_assembly_info&);
-    void assemble_model(const model_assembly_info&);
+
+    // Bulk additions grow the arrays once and fill in the shapes and their bounding boxes on all
+    // threads. Each shape has the material at the same position.
+    void reserve_shapes(size_t sphere_count, size_t triangle_count);
+    void add_sphere_shapes(const sphere_shape*, const material*, size_t count);
+    void add_triangle_shapes(const triangle_shape*, const material*, size_t count);
+    void assemble_cuboids(const cuboid_assembly_info*, size_t count);
+    void add_shape_batches(const std::vector<shape_batch>&);
+    void assemble_model(const model_assembly_info&, mesh_encoding = mesh_encoding::indexed);
+    void assemble_indexed_model(const model_assembly_info&);
+    void assemble_quantized_model(const model_assembly_info&);
 
     // Materials
 
-    std::vector<dielectric_material> dielectric_materials;
-    std::vector<diffuse_material> diffuse_materials;
-    std::vector<emit_light_material> emit_light_materials;
-    std::vector<reflect_material> reflect_materials;
+    mapped_array<dielectric_material> dielectric_materials;
+    mapped_array<diffuse_material> diffuse_materials;
+    mapped_array<emit_light_material> emit_light_materials;
+    mapped_array<reflect_material> reflect_materials;
 
     material add_dielectric_material(const dielectric_material&, invalidable_array_index normal_map_index);
     material add_dielectric_material(float refractive_index, const texture& albedo, const texture& normals);
@@ -66,11 +146,11 @@ struct scene
 
     // Textures
 
-    std::vector<checker_texture> checker_textures;
-    std::vector<constant_texture> constant_textures;
-    std::vector<image_texture> image_textures;
-    std::vector<noise_texture> noise_textures;
-    std::vector<normal_texture> normal_textures;
+    mapped_array<checker_texture> checker_textures;
+    mapped_array<constant_texture> constant_textures;
+    mapped_array<image_texture> image_textures;
+    mapped_array<noise_texture> noise_textures;
+    mapped_array<normal_texture> normal_textures;
 
     texture add_checker_texture(const checker_texture&);
     texture add_checker_texture(const scale_2D&, const color& odd, const color& even);
@@ -83,6 +163,11 @@ struct scene
     texture add_image_texture(array_index image_index, const min_max<texture_position_2D>& image_fragment,
         wrap_method, filtering_method);
     
+    // Swaps the Catmull-Rom and linear filters of all image textures, and the linear filters of normal
+    // textures, for their stochastic versions, or back, to compare them.
+    void use_stochastic_filtering(bool);
+    bool stochastic_filtering = false;
+
     texture add_noise_texture(const noise_texture&);
     texture add_noise_texture(const float&, const color&);
 
@@ -95,9 +180,23 @@ struct scene
 
     std::vector<image> images;
     std::vector<normal_map> normal_maps;
+    asset_requests image_requests;
+    asset_requests normal_map_requests;
+    // Converted images are cached here across runs once a path is set, the cache is off by default.
+    std::filesystem::path texture_cache_directory;
 
     uint32_t add_image(const image&);
     uint32_t add_image(std::string_view path);
     uint32_t add_normal_map(const normal_map&);
     uint32_t add_normal_map(std::string_view path);
+    // Decodes the images added by path on a few threads, this has to happen before rendering.
+    void resolve_assets();
+    // Reads the cached images through the pages instead of keeping them mapped whole. Images that are not
+    // mapped from the texture cache stay in memory, and are reported.
+    void page_textures(const std::shared_ptr<page_cache>&);
+    std::shared_ptr<page_cache> texture_pages;
+
+private:
+    void rebuild_hierarchy();
+    hierarchy_refit refit_current_hierarchy();
 };
\ No newline at end of file
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <render_objects/render_plan.hpp>
+
+#include <filesystem>
+#include <optional>
+
+// A render plan flattened into one file: a header, a table of sections, then the sections, each
+// aligned for mapping. The camera, every scene array, the hierarchy and the images are stored, the
+// animation is not. Loading maps the file and points the scene arrays and image texels into it, so
+// nothing is read or copied until it is used, and arrays are only copied when edited.
+void save_render_plan(const std::filesystem::path& file_path, const render_plan&);
+std::optional<render_plan> load_render_plan(const std::filesystem::path& file_path);
\ No newline at end of file
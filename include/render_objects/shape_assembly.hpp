@@ -1,15 +1,15 @@
 #pragma once
 
 #include <render_objects/materials.hpp>
+#include <render_objects/shapes.hpp>
 #include <util/sizes.hpp>
 #include <util/vector.hpp>
 #include <util/vertex.hpp>
 
-#include <external/tiny_obj_loader.h>
-
 #include <glm/gtx/quaternion.hpp>
 
 #include <array>
+#include <string_view>
 #include <vector>
 
 struct quad_assembly_info
@@ -34,10 +34,40 @@ struct cuboid_assembly_info
     bool face_inwards = false;
 };
 
+std::array<triangle_shape, 2> quad_triangles(const quad_assembly_info&);
+std::array<quad_assembly_info, 6> cuboid_faces(const cuboid_assembly_info&);
+
+// Shapes generated on one thread, to be added to a scene together with the batches of other threads.
+struct shape_batch
+{
+    std::vector<sphere_shape> spheres;
+    std::vector<material> sphere_materials;
+    std::vector<triangle_shape> triangles;
+    std::vector<material> triangle_materials;
+
+    void add_sphere_shape(const sphere_shape&, const material&);
+    void add_triangle_shape(const triangle_shape&, const material&);
+    void assemble_quad(const quad_assembly_info&);
+    void assemble_cuboid(const cuboid_assembly_info&);
+};
+
+// How assembled models store their vertices: as floats, or quantized to 12 bytes per vertex at the
+// cost of 16-bit position precision within the model bounds. A quantized model is a single shape with
+// a hierarchy of its own, so each triangle only takes its indices and its share of the nodes.
+enum class mesh_encoding
+{
+    indexed, quantized
+};
+
+// An indexed mesh, every triangle is three indices into the vertices.
 struct model_assembly_info
 {
     std::vector<vertex> vertices;
+    std::vector<std::array<uint32_t, 3>> triangles;
     material mat;
 };
 
-model_assembly_info load_model(const std::string_view path);
\ No newline at end of file
+// Maps the OBJ file and parses it in chunks on separate threads, 0 threads uses all hardware threads.
+// Polygons are split into triangles and triangles without area are dropped. Corners without normals
+// get the area-weighted normal of the faces around their position.
+model_assembly_info load_model(std::string_view path, uint32_t thread_count = 0);
\ No newline at end of file
@@ -4,14 +4,16 @@
 #include <util/barycentric.hpp>
 #include <util/geometric.hpp>
 #include <util/numeric.hpp>
+#include <util/packing.hpp>
 #include <util/sizes.hpp>
 #include <util/vector.hpp>
 
 #include <array>
+#include <cstdint>
 
 enum class shape_type
 {
-    none, sphere, plane, triangle
+    none, sphere, plane, triangle, mesh_triangle, quantized_mesh, moving_sphere, moving_mesh_triangle
 };
 
 struct shape
@@ -40,6 +42,18 @@ struct sphere_shape : sphere
     }
 };
 
+// A sphere moving in a straight line from its origin to the end origin over the scene's motion interval.
+struct moving_sphere_shape : sphere_shape
+{
+    position_3D end_origin;
+
+    // At a fraction of the motion interval.
+    sphere_shape at(const float in_motion) const
+    {
+        return sphere_shape{ sphere{ glm::mix(this->origin, this->end_origin, in_motion), this->radius }, this->axial_tilt };
+    }
+};
+
 struct triangle_shape : triangle
 {
     direction_3D normal_a, normal_b, normal_c;
@@ -57,4 +71,62 @@ struct triangle_shape : triangle
                 std::max(std::max(this->a.y, this->b.y), this->c.y),
                 std::max(std::max(this->a.z, this->b.z), this->c.z), }, };
     }
+};
+
+// A triangle of a mesh, its corners index the vertex attributes the scene's meshes share. Moving mesh
+// triangles are the same, with their corners also indexing the positions at the end of the motion.
+struct mesh_triangle_shape
+{
+    std::array<uint32_t, 3> indices;
+};
+
+// A vertex of a quantized mesh in 12 bytes: the position is 16-bit fractions of the mesh bounds, the
+// normal is octahedral and the mapping is two half floats.
+struct quantized_vertex
+{
+    std::array<uint16_t, 3> position;
+    uint16_t normal;
+    uint32_t mapping;
+
+    direction_3D unpack_normal() const
+    {
+        return unpack_octahedral_16(this->normal);
+    }
+
+    barycentric_2D unpack_mapping() const
+    {
+        const glm::vec2 mapping = glm::unpackHalf2x16(this->mapping);
+        return barycentric_2D{ mapping.x, mapping.y };
+    }
+};
+
+// The bounds the positions of a quantized mesh are fractions of, and where its triangles and the
+// nodes of its hierarchy start. Node and triangle indices in that hierarchy count from there.
+struct quantized_mesh
+{
+    position_3D origin;
+    displacement_3D step;
+    uint32_t first_triangle;
+    uint32_t first_node;
+
+    std::array<uint16_t, 3> quantize(const position_3D& in_position) const
+    {
+        std::array<uint16_t, 3> quantized;
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            const float steps = this->step[axis] > 0.f ? (in_position[axis] - this->origin[axis]) / this->step[axis] : 0.f;
+            quantized[axis] = uint16_t(glm::clamp(glm::round(steps), 0.f, 65535.f));
+        }
+        return quantized;
+    }
+
+    position_3D unpack_position(const quantized_vertex& in_vertex) const
+    {
+        return this->origin + this->step * displacement_3D{ in_vertex.position[0], in_vertex.position[1], in_vertex.position[2] };
+    }
+};
+
+struct quantized_mesh_triangle_shape
+{
+    std::array<uint32_t, 3> indices;
 };
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <render_objects/image.hpp>
+
+#include <filesystem>
+#include <optional>
+#include <string_view>
+
+// Identifies the version of a source file the cached texture was converted from.
+struct source_stamp
+{
+    int64_t modified;
+    uint64_t size;
+
+    static source_stamp of(const std::filesystem::path& source_path);
+};
+
+struct cached_vector_map
+{
+    vector_map map;
+    uint64_t content_hash;
+};
+
+// Textures converted to the internal texel format and layout, mip levels included, one file per
+// source path and kind of map. Cached texels are mapped from the file rather than read.
+std::optional<cached_vector_map> load_cached_vector_map(const std::filesystem::path& cache_directory,
+    std::string_view source_path, std::string_view kind, const source_stamp&);
+void store_cached_vector_map(const std::filesystem::path& cache_directory,
+    std::string_view source_path, std::string_view kind, const source_stamp&, const vector_map&, uint64_t content_hash);
\ No newline at end of file
@@ -39,6 +39,7 @@ struct image_texture
     min_max<texture_position_2D> image_fragment;
     wrap_method wrap;
     filtering_method filtering;
+    uint32_t sampler = 0;
 };
 
 struct noise_texture
@@ -53,4 +54,5 @@ struct normal_texture
     min_max<texture_position_2D> map_fragment;
     wrap_method wrap;
     filtering_method filtering;
+    uint32_t sampler = 0;
 };
\ No newline at end of file
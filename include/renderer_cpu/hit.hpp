@@ -15,12 +15,13 @@ struct hit_record
     displacement_3D normal;
     material mat;
     barycentric_2D mapping;
+    float mapping_footprint;
     bool occurred = true;
 
     static hit_record nope()
     {
         return hit_record{ 0.f, position_3D{ 0.f }, displacement_3D{ 0.f },
-            material{ material_type::none, 0 }, barycentric_2D{ 0.f, 0.f }, false };
+            material{ material_type::none, 0 }, barycentric_2D{ 0.f, 0.f }, 0.f, false };
     }
 };
 
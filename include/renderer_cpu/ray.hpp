@@ -4,13 +4,33 @@
 #include <util/geometric.hpp>
 #include <util/pairs.hpp>
 
+inline static constexpr int32_t default_trace_depth = 50;
+
+// Approximates the footprint of a ray as a cone, used to pick texture levels of detail.
+struct ray_cone
+{
+    float width = 0.f;
+    float spread = 0.f;
+
+    float width_at(const float in_distance) const
+    {
+        return this->width + (this->spread * in_distance);
+    }
+
+    ray_cone at_distance(const float in_distance, const float in_added_spread = 0.f) const
+    {
+        return ray_cone{ this->width_at(in_distance), this->spread + in_added_spread };
+    }
+};
+
 struct ray : line
 {
     const displacement_3D inverse_direction;
     const float time;
+    const ray_cone cone;
 
     ray();
-    ray(const line&, float time = 0.f);
-    static ray shoot(const struct camera&, const barycentric_2D&);
-    color trace(const struct scene&, int32_t depth = 50) const;
+    ray(const line&, float time = 0.f, const ray_cone& = {});
+    static ray shoot(const struct camera&, const barycentric_2D&, float pixel_spread);
+    color trace(const struct scene&, int32_t depth = default_trace_depth) const;
 };
\ No newline at end of file
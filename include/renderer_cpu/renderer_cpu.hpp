@@ -1,21 +1,63 @@
 #pragma once
 
+#include <renderer_cpu/ray.hpp>
 #include <util/colors.hpp>
+#include <util/pairs.hpp>
 #include <util/sizes.hpp>
 #include <util/vector.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <future>
+#include <string_view>
 #include <vector>
 
+using frame_sink = std::function<void(std::vector<rgba>, const struct animation_frame&)>;
+
+struct budgeted_render
+{
+    std::vector<rgba> pixels;
+    std::vector<uint32_t> sample_counts;
+    min_max<uint32_t> sample_count_range;
+    float average_sample_count;
+    uint32_t pass_count;
+};
+
+struct preview_update
+{
+    uint32_t pixel_stride;
+    int32_t depth;
+    uint32_t samples_per_pixel;
+};
+
+using preview_sink = std::function<void(const std::vector<rgba>&, const preview_update&)>;
+
+struct render_pass_info
+{
+    uint32_t samples_per_pixel = 1;
+    uint32_t pixel_stride = 1;
+    int32_t depth = default_trace_depth;
+};
+
 class renderer_cpu
 {
 public:
     renderer_cpu(uint32_t sample_count, uint32_t thread_count);
     std::vector<rgba> render_scene(const struct render_plan&) const;
+    void render_sequence(struct render_plan&, const frame_sink&) const;
+    budgeted_render render_scene_within(const struct render_plan&, std::chrono::milliseconds time_budget) const;
+    bool render_preview(const struct render_plan&, const std::atomic<bool>& cancelled, const preview_sink&) const;
+    void render_scene_to_file(const struct render_plan&, std::string_view path, uint32_t band_height) const;
     color render_single_pixel(const struct render_plan&, const pixel_position&) const;
 
 private:
     color render_pixel(const struct render_plan&, const pixel_position&, const extent_2D<float>& inverse_size) const;
+    void render_rows(const struct render_plan&, uint32_t first_row, uint32_t row_count, rgba* out_pixels) const;
+    color sample_pixel(const struct render_plan&, const pixel_position&, const extent_2D<float>& inverse_size,
+        int32_t depth = default_trace_depth) const;
+    bool render_pass(const struct render_plan&, const render_pass_info&, const std::function<bool()>& should_stop,
+        std::vector<color>& inout_colors, std::vector<uint32_t>& inout_sample_counts) const;
 
 private:
     const uint32_t sample_count;
@@ -4,5 +4,8 @@
 #include <util/pairs.hpp>
 #include <util/vector.hpp>
 
-color color_on_texture(const struct scene&, const struct texture&, const struct barycentric_2D&, const position_3D&);
-direction_3D normal_on_texture(const struct scene&, const struct normal_texture&, const struct barycentric_2D&);
\ No newline at end of file
+// The footprint is the width of the ray cone in texture coordinates, zero samples the full resolution.
+color color_on_texture(const struct scene&, const struct texture&, const struct barycentric_2D&, const position_3D&,
+    float footprint = 0.f);
+direction_3D normal_on_texture(const struct scene&, const struct normal_texture&, const struct barycentric_2D&,
+    float footprint = 0.f);
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+
+// Cache line aligned memory. Allocations of a huge page or more are aligned to huge pages and ask the
+// system to back them with huge pages, so arrays read for every ray take fewer TLB entries.
+void* allocate_aligned_bytes(size_t size);
+void free_aligned_bytes(void* bytes, size_t size);
+
+template <typename T>
+struct aligned_allocator
+{
+    using value_type = T;
+
+    aligned_allocator() = default;
+
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U>&)
+    {
+    }
+
+    T* allocate(const size_t in_count)
+    {
+        return static_cast<T*>(allocate_aligned_bytes(in_count * sizeof(T)));
+    }
+
+    void deallocate(T* in_elements, const size_t in_count)
+    {
+        free_aligned_bytes(in_elements, in_count * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const aligned_allocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const aligned_allocator<U>&) const { return false; }
+};
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Hands out memory from large blocks and takes it all back at once, either on reset or by rewinding
+// to a marker. The blocks are kept for reuse, so a warmed up arena never allocates.
+class monotonic_arena
+{
+public:
+    struct marker
+    {
+        size_t block;
+        size_t offset;
+    };
+
+    explicit monotonic_arena(size_t block_size = size_t(1) << 20);
+
+    void* allocate(size_t size, size_t alignment);
+
+    template <typename T>
+    T* allocate(const size_t in_count)
+    {
+        static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
+        return static_cast<T*>(this->allocate(in_count * sizeof(T), alignof(T)));
+    }
+
+    marker mark() const { return marker{ this->current_block, this->current_offset }; }
+    void rewind(const marker& in_marker);
+    void reset() { this->rewind(marker{ 0, 0 }); }
+
+    size_t capacity() const;
+
+private:
+    struct block
+    {
+        std::unique_ptr<uint8_t[]> bytes;
+        size_t size;
+    };
+
+    const size_t block_size;
+    std::vector<block> blocks;
+    size_t current_block = 0;
+    size_t current_offset = 0;
+};
+
+// Rewinds the arena when leaving the scope, for memory that only lives within it.
+class arena_scope
+{
+public:
+    explicit arena_scope(monotonic_arena& inout_arena)
+        : arena(inout_arena)
+        , start(inout_arena.mark())
+    {
+    }
+
+    ~arena_scope()
+    {
+        this->arena.rewind(this->start);
+    }
+
+    arena_scope(const arena_scope&) = delete;
+    arena_scope& operator=(const arena_scope&) = delete;
+
+private:
+    monotonic_arena& arena;
+    const monotonic_arena::marker start;
+};
+
+// The scratch arena of the calling thread. Renderers reset it for every pixel or row they take on.
+monotonic_arena& thread_scratch();
+
+// A stack in arena memory, which moves to a block twice the size when full.
+template <typename T>
+class scratch_stack
+{
+public:
+    explicit scratch_stack(monotonic_arena& inout_arena, const size_t in_capacity = 64)
+        : arena(inout_arena)
+        , elements(inout_arena.allocate<T>(in_capacity))
+        , capacity(in_capacity)
+    {
+    }
+
+    bool empty() const { return this->count == 0; }
+
+    void push(const T& in_element)
+    {
+        if (this->count == this->capacity)
+        {
+            T* grown = this->arena.allocate<T>(2 * this->capacity);
+            std::memcpy(grown, this->elements, this->count * sizeof(T));
+            this->elements = grown;
+            this->capacity *= 2;
+        }
+        this->elements[this->count++] = in_element;
+    }
+
+    T pop()
+    {
+        return this->elements[--this->count];
+    }
+
+private:
+    monotonic_arena& arena;
+    T* elements;
+    size_t capacity;
+    size_t count = 0;
+};
\ No newline at end of file
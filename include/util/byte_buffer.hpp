@@ -0,0 +1,119 @@
+#pragma once
+
+#include <util/mapped_file.hpp>
+#include <util/page_cache.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Bytes that are either owned, borrowed from a memory-mapped file which stays mapped while any
+// buffer refers to it, or read through a page cache. Writing to borrowed or paged bytes copies them
+// first. Paged bytes are not contiguous in memory, and can only be read with bytes_at.
+class byte_buffer
+{
+public:
+    byte_buffer() = default;
+
+    explicit byte_buffer(const size_t in_size)
+        : owned(in_size)
+    {
+    }
+
+    byte_buffer(std::shared_ptr<const mapped_file> in_mapping, const uint8_t* in_data, const size_t in_size)
+        : mapping(std::move(in_mapping))
+        , mapped_data(in_data)
+        , mapped_size(in_size)
+    {
+    }
+
+    const uint8_t* data() const
+    {
+        return this->mapping ? this->mapped_data : this->owned.data();
+    }
+
+    // Points at the bytes, after copying them to the scratch space if the buffer is paged.
+    const uint8_t* bytes_at(const size_t in_offset, const size_t in_size, uint8_t* out_scratch) const
+    {
+        if (this->pages)
+        {
+            this->pages->read(this->page_source, in_offset, in_size, out_scratch);
+            return out_scratch;
+        }
+        return this->data() + in_offset;
+    }
+
+    uint8_t* data()
+    {
+        this->make_owned();
+        return this->owned.data();
+    }
+
+    size_t size() const
+    {
+        return (this->mapping || this->pages) ? this->mapped_size : this->owned.size();
+    }
+
+    size_t capacity() const
+    {
+        return (this->mapping || this->pages) ? this->mapped_size : this->owned.capacity();
+    }
+
+    void resize(const size_t in_size)
+    {
+        this->make_owned();
+        this->owned.resize(in_size);
+    }
+
+    bool is_mapped() const
+    {
+        return bool(this->mapping);
+    }
+
+    bool is_paged() const
+    {
+        return bool(this->pages);
+    }
+
+    // Reads mapped bytes through the page cache from now on, releasing the mapping.
+    bool page(std::shared_ptr<page_cache> in_pages, const size_t in_page_size)
+    {
+        if (!this->mapping)
+        {
+            return false;
+        }
+        this->page_source = in_pages->add_source(this->mapping->path(),
+            uint64_t(this->mapped_data - this->mapping->data()), this->mapped_size, in_page_size);
+        this->pages = std::move(in_pages);
+        this->mapping.reset();
+        this->mapped_data = nullptr;
+        return true;
+    }
+
+private:
+    void make_owned()
+    {
+        if (this->mapping)
+        {
+            this->owned.assign(this->mapped_data, this->mapped_data + this->mapped_size);
+            this->mapping.reset();
+            this->mapped_data = nullptr;
+            this->mapped_size = 0;
+        }
+        else if (this->pages)
+        {
+            this->owned.resize(this->mapped_size);
+            this->pages->read(this->page_source, 0, this->mapped_size, this->owned.data());
+            this->pages.reset();
+            this->mapped_size = 0;
+        }
+    }
+
+private:
+    std::vector<uint8_t> owned;
+    std::shared_ptr<const mapped_file> mapping;
+    const uint8_t* mapped_data = nullptr;
+    size_t mapped_size = 0;
+    std::shared_ptr<page_cache> pages;
+    uint32_t page_source = 0;
+};
\ No newline at end of file
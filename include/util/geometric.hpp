@@ -10,6 +10,7 @@
 #include <glm/gtx/quaternion.hpp>
 
 #include <algorithm>
+#include <limits>
 #include <utility>
 
 struct line
@@ -93,6 +94,30 @@ struct axis_aligned_box
         return this->min + displacement_3D{ this->width() * 0.5f, this->height() * 0.5f, this->depth() * 0.5f };
     }
 
+    bool is_empty() const
+    {
+        return this->min.x > this->max.x;
+    }
+
+    float surface_area() const
+    {
+        return this->is_empty() ? 0.f
+            : 2.f * ((this->width() * this->height()) + (this->height() * this->depth()) + (this->depth() * this->width()));
+    }
+
+    void extend(const axis_aligned_box& in_box)
+    {
+        this->min = glm::min(this->min, in_box.min);
+        this->max = glm::max(this->max, in_box.max);
+    }
+
+    // Contains nothing, and extending it gives the other box.
+    static axis_aligned_box empty()
+    {
+        constexpr float infinity = std::numeric_limits<float>::infinity();
+        return axis_aligned_box{ position_3D{ infinity }, position_3D{ -infinity } };
+    }
+
     static axis_aligned_box zero()
     {
         return axis_aligned_box{ position_3D{ 0.f }, position_3D{ 0.f } };
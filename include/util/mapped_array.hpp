@@ -0,0 +1,116 @@
+#pragma once
+
+#include <util/aligned_allocator.hpp>
+#include <util/mapped_file.hpp>
+
+#include <initializer_list>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Elements that are either owned, or borrowed from a memory-mapped file which stays mapped while any
+// array refers to it. Any non-const access to borrowed elements copies them first, so arrays loaded
+// from a file are read in place and can still be edited.
+template <typename T, typename Allocator = std::allocator<T>>
+class mapped_array
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    mapped_array() = default;
+
+    mapped_array(std::initializer_list<T> in_elements)
+        : owned(in_elements)
+    {
+    }
+
+    mapped_array(std::vector<T, Allocator> in_elements)
+        : owned(std::move(in_elements))
+    {
+    }
+
+    mapped_array(std::shared_ptr<const mapped_file> in_mapping, const T* in_data, const size_t in_size)
+        : mapping(std::move(in_mapping))
+        , mapped_data(in_data)
+        , mapped_size(in_size)
+    {
+    }
+
+    size_t size() const { return this->mapping ? this->mapped_size : this->owned.size(); }
+    size_t capacity() const { return this->mapping ? this->mapped_size : this->owned.capacity(); }
+    bool empty() const { return this->size() == 0; }
+    bool is_mapped() const { return bool(this->mapping); }
+
+    const T* data() const { return this->mapping ? this->mapped_data : this->owned.data(); }
+    const T& operator[](const size_t in_index) const { return this->data()[in_index]; }
+    const T* begin() const { return this->data(); }
+    const T* end() const { return this->data() + this->size(); }
+    const T* cbegin() const { return this->begin(); }
+    const T* cend() const { return this->end(); }
+    const T& front() const { return *this->begin(); }
+    const T& back() const { return *(this->end() - 1); }
+
+    T* data() { this->make_owned(); return this->owned.data(); }
+    T& operator[](const size_t in_index) { return this->data()[in_index]; }
+    T* begin() { return this->data(); }
+    T* end() { return this->data() + this->owned.size(); }
+    T& front() { return *this->begin(); }
+    T& back() { return *(this->end() - 1); }
+
+    void push_back(const T& in_element)
+    {
+        this->make_owned();
+        this->owned.push_back(in_element);
+    }
+
+    void reserve(const size_t in_capacity)
+    {
+        this->make_owned();
+        this->owned.reserve(in_capacity);
+    }
+
+    void resize(const size_t in_size)
+    {
+        this->make_owned();
+        this->owned.resize(in_size);
+    }
+
+    void clear()
+    {
+        this->mapping.reset();
+        this->mapped_data = nullptr;
+        this->mapped_size = 0;
+        this->owned.clear();
+    }
+
+    void shrink_to_fit()
+    {
+        this->owned.shrink_to_fit();
+    }
+
+private:
+    void make_owned()
+    {
+        if (this->mapping)
+        {
+            this->owned.assign(this->mapped_data, this->mapped_data + this->mapped_size);
+            this->mapping.reset();
+            this->mapped_data = nullptr;
+            this->mapped_size = 0;
+        }
+    }
+
+private:
+    std::vector<T, Allocator> owned;
+    std::shared_ptr<const mapped_file> mapping;
+    const T* mapped_data = nullptr;
+    size_t mapped_size = 0;
+};
+
+// For arrays read for every ray, see aligned_allocator.
+template <typename T>
+using aligned_array = mapped_array<T, aligned_allocator<T>>;
\ No newline at end of file
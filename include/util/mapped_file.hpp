@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A whole file mapped read-only into memory. The pages are shared with every other process
+// mapping the same file.
+class mapped_file
+{
+public:
+    explicit mapped_file(const std::string& path);
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const uint8_t* data() const { return this->bytes; }
+    size_t size() const { return this->byte_count; }
+    const std::string& path() const { return this->file_path; }
+
+private:
+    const std::string file_path;
+    const uint8_t* bytes = nullptr;
+    size_t byte_count = 0;
+#if defined(_WIN32)
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+};
\ No newline at end of file
@@ -10,6 +10,8 @@ public:
     perlin();
 
     float noise(const glm::vec3&) const;
+    // Evaluates many points at once, four at a time with SSE.
+    void noise(const glm::vec3* points, size_t count, float* out_values) const;
 
 private:
     inline static constexpr size_t N_PERMUTATIONS = 256;
@@ -19,17 +21,27 @@ private:
     std::array<uint32_t, N_PERMUTATIONS> z_permutations;
 };
 
+// The octaves are evaluated together through the batched noise.
 inline static float turbulence(const perlin& in_noise, const glm::vec3& in_p, int in_depth = 7)
 {
+    constexpr int max_depth = 16;
+    in_depth = glm::clamp(in_depth, 0, max_depth);
+
+    std::array<glm::vec3, max_depth> octaves;
+    octaves[0] = in_p;
+    for (int i = 1; i < in_depth; ++i)
+    {
+        octaves[i] = octaves[i - 1] * 2.f;
+    }
+    std::array<float, max_depth> values;
+    in_noise.noise(octaves.data(), in_depth, values.data());
+
     float accumulate = 0.f;
     float weight = 1.f;
-    glm::vec3 p_pow2 = in_p;
-
-    for (; in_depth > 0; --in_depth)
+    for (int i = 0; i < in_depth; ++i)
     {
-        accumulate += weight * in_noise.noise(p_pow2);
+        accumulate += weight * values[i];
         weight *= 0.5f;
-        p_pow2 *= 2.f;
     }
     return glm::abs(accumulate);
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <util/vector.hpp>
+
+#include <glm/gtc/packing.hpp>
+
+#include <cstdint>
+
+// Octahedral unit vectors, two signed bytes per direction.
+
+inline static uint16_t pack_octahedral_16(const direction_3D& in_direction)
+{
+    const direction_3D d = in_direction / (glm::abs(in_direction.x) + glm::abs(in_direction.y) + glm::abs(in_direction.z));
+    direction_2D folded = { d.x, d.y };
+    if (d.z < 0.f)
+    {
+        folded = {
+            (1.f - glm::abs(d.y)) * (d.x >= 0.f ? 1.f : -1.f),
+            (1.f - glm::abs(d.x)) * (d.y >= 0.f ? 1.f : -1.f),
+        };
+    }
+    return glm::packSnorm2x8(folded);
+}
+
+inline static direction_3D unpack_octahedral_16(const uint16_t in_packed)
+{
+    const direction_2D folded = glm::unpackSnorm2x8(in_packed);
+    direction_3D d = { folded.x, folded.y, 1.f - glm::abs(folded.x) - glm::abs(folded.y) };
+    const float unfold = glm::max(-d.z, 0.f);
+    d.x += d.x >= 0.f ? -unfold : unfold;
+    d.y += d.y >= 0.f ? -unfold : unfold;
+    return glm::normalize(d);
+}
+
+// Half floats
+
+inline static void pack_half_3(const glm::vec3& in_value, uint16_t* out_packed)
+{
+    out_packed[0] = glm::packHalf1x16(in_value.x);
+    out_packed[1] = glm::packHalf1x16(in_value.y);
+    out_packed[2] = glm::packHalf1x16(in_value.z);
+}
+
+inline static glm::vec3 unpack_half_3(const uint16_t* in_packed)
+{
+    return glm::vec3{
+        glm::unpackHalf1x16(in_packed[0]),
+        glm::unpackHalf1x16(in_packed[1]),
+        glm::unpackHalf1x16(in_packed[2]),
+    };
+}
\ No newline at end of file
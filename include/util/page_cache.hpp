@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+// Keeps fixed-size pages of file regions in memory under a byte budget, loading them on demand and
+// evicting with the CLOCK policy. Every thread remembers the pages it read last, so the texels of one
+// filter footprint take a shared lock on one of several shards only once. Such a page stays alive
+// while a thread remembers it, even after it was evicted. Sources have to be added before reading
+// starts.
+class page_cache
+{
+public:
+    struct statistics
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t resident_bytes;
+        size_t byte_budget;
+    };
+
+    explicit page_cache(size_t byte_budget);
+
+    uint32_t add_source(const std::filesystem::path&, uint64_t offset, uint64_t size, size_t page_size);
+    void read(uint32_t source, uint64_t offset, size_t size, uint8_t* out_bytes);
+    statistics stats() const;
+    void print_stats() const;
+
+private:
+    struct source
+    {
+        std::ifstream file;
+        std::mutex file_mtx;
+        uint64_t offset;
+        uint64_t size;
+        size_t page_size;
+    };
+
+    struct page
+    {
+        std::vector<uint8_t> bytes;
+        std::atomic<bool> referenced = true;
+    };
+
+    struct shard
+    {
+        mutable std::shared_mutex mtx;
+        std::unordered_map<uint64_t, std::shared_ptr<page>> pages;
+    };
+
+    // Only written by their own thread, and summed when reported.
+    struct alignas(64) thread_counts
+    {
+        std::atomic<uint64_t> hits = 0;
+        std::atomic<uint64_t> misses = 0;
+    };
+
+    inline static constexpr size_t recent_page_count = 8;
+
+    struct recent_pages
+    {
+        uint64_t cache_id = 0;
+        thread_counts* counts = nullptr;
+        std::array<uint64_t, recent_page_count> keys = {};
+        std::array<std::shared_ptr<const page>, recent_page_count> pages;
+        size_t next = 0;
+    };
+
+    recent_pages& recent_pages_of_this_thread();
+    const page& find_page(recent_pages&, source&, uint32_t source_index, uint32_t page_index);
+    shard& shard_of(uint64_t key);
+    std::vector<uint8_t> load_page(source&, uint32_t page_index);
+    std::shared_ptr<page> insert_page(uint64_t key, std::shared_ptr<page>&&);
+    void evict_over_budget();
+
+private:
+    inline static constexpr size_t shard_count = 64;
+
+    const uint64_t id;
+    const size_t byte_budget;
+    std::vector<std::unique_ptr<source>> sources;
+    std::array<shard, shard_count> shards;
+
+    mutable std::mutex clock_mtx;
+    std::vector<uint64_t> clock;
+    size_t clock_hand = 0;
+    size_t resident_bytes = 0;
+
+    mutable std::mutex thread_counts_mtx;
+    std::vector<std::unique_ptr<thread_counts>> all_thread_counts;
+    std::atomic<uint64_t> eviction_count = 0;
+};
\ No newline at end of file
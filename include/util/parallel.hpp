@@ -0,0 +1,32 @@
+#pragma once
+
+#include <algorithm>
+#include <future>
+#include <vector>
+
+// Calls the function with consecutive [begin, end) ranges covering [0, count), each on its own thread.
+template <typename Function>
+inline static void parallel_for(const size_t in_count, const uint32_t in_thread_count, const Function& in_function)
+{
+    const size_t job_count = std::max<size_t>(1, std::min<size_t>(in_thread_count, in_count));
+    if (job_count == 1)
+    {
+        in_function(size_t(0), in_count);
+        return;
+    }
+
+    std::vector<std::future<void>> jobs;
+    jobs.reserve(job_count);
+    for (size_t i = 0; i < job_count; ++i)
+    {
+        const size_t begin = in_count * i / job_count;
+        const size_t end = in_count * (i + 1) / job_count;
+        jobs.emplace_back(std::async(std::launch::async, [&in_function, begin, end]() {
+            in_function(begin, end);
+        }));
+    }
+    for (std::future<void>& job : jobs)
+    {
+        job.get();
+    }
+}
\ No newline at end of file
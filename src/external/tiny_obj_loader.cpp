@@ -1,2 +0,0 @@
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <external/tiny_obj_loader.h>
\ No newline at end of file
@@ -1,11 +1,15 @@
+#include <output/image_writer.hpp>
+#include <render_objects/memory_report.hpp>
 #include <render_objects/render_plan.hpp>
+#include <render_objects/scene_file.hpp>
 #include <renderer_cpu/renderer_cpu.hpp>
-#include <util/string.hpp>
-
-#include <external/stb_image_write.h>
 
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <thread>
 
 #ifdef NDEBUG
 #   define THREAD_COUNT 20
@@ -14,48 +18,82 @@
 #   define SINGLE_PIXEL_TEST 0
 #endif
 
-using namespace std::string_literals;
-
-void export_image(const std::vector<rgba>& image, const extent_2D<uint32_t> image_size, const std::string_view path)
-{
-    std::cout << "Writing to file... ";
-
-    constexpr uint32_t channels = 4;
-    if (string_ends_with(path, ".png"))
-    {
-        stbi_write_png(path.data(), image_size.width, image_size.height, channels, image.data(),
-            image_size.width * channels);
-    }
-    else if (string_ends_with(path, ".jpg"))
-    {
-        constexpr int32_t quality = 100;
-        stbi_write_jpg(path.data(), image_size.width, image_size.height, channels, image.data(), quality);
-    }
-    else
-    {
-        const size_t last_dot_pos = path.find_last_of('.');
-        const std::string_view format = path.substr(last_dot_pos + 1, path.size() - last_dot_pos - 1);
-        throw std::runtime_error("Unsupported image format: "s + format.data());
-    }
-
-    std::cout << "Done." << std::endl;
-}
+#define ANIMATION_TEST 0
+#define TIME_BUDGET_TEST 0
+#define PREVIEW_TEST 0
+#define BANDED_OUTPUT_TEST 0
+#define TEXTURE_PAGE_BUDGET_MB 0
+#define STOCHASTIC_FILTERING_TEST 0
+#define SCENE_FILE_TEST 0
+#define MEMORY_REPORT_TEST 0
+#define LAZY_HIERARCHY_TEST 0
 
 int main()
 {
     try
     {
         const extent_2D<uint32_t> image_size = { 500, 500 };
-        const render_plan plan = render_plan::cornell_box(image_size);
+#if ANIMATION_TEST
+        render_plan plan = render_plan::grass_block_turntable(image_size);
+#elif SCENE_FILE_TEST
+        std::optional<render_plan> loaded_plan = load_render_plan("cornell_box.scene");
+        render_plan plan = loaded_plan ? std::move(*loaded_plan) : render_plan::cornell_box(image_size);
+        if (!loaded_plan)
+        {
+            save_render_plan("cornell_box.scene", plan);
+        }
+#elif TEXTURE_PAGE_BUDGET_MB
+        // Only textures mapped from the texture cache can be paged.
+        render_plan plan = render_plan::test_scene(image_size, "texture_cache");
+#else
+        render_plan plan = render_plan::cornell_box(image_size);
+#endif
+#if TEXTURE_PAGE_BUDGET_MB
+        const auto texture_pages = std::make_shared<page_cache>(size_t(TEXTURE_PAGE_BUDGET_MB) << 20);
+        plan.world.page_textures(texture_pages);
+#endif
+#if STOCHASTIC_FILTERING_TEST
+        plan.world.use_stochastic_filtering(true);
+#endif
+#if LAZY_HIERARCHY_TEST
+        plan.world.hierarchy = {};
+        plan.world.lazy_hierarchy = make_lazy_hierarchy(plan.world.shapes);
+#endif
+#if MEMORY_REPORT_TEST
+        const memory_report memory = report_memory(plan.world);
+        memory.print(std::cout);
+        std::ofstream{ "memory.json" } << memory.to_json();
+#endif
         renderer_cpu renderer{ 500, THREAD_COUNT };
 #if SINGLE_PIXEL_TEST
         const pixel_position pixel_pos = { 254, 400 };
         const color pixel = renderer.render_single_pixel(plan, pixel_pos);
         std::cout << "Rendered color {" << pixel.r << " " << pixel.g << " " << pixel.b
             << "} at pixel {" << pixel_pos.x << " " << pixel_pos.y << "}" << std::endl;
+#elif ANIMATION_TEST
+        renderer.render_sequence(plan, [&](const std::vector<rgba> image, const animation_frame& frame) {
+            std::ostringstream path;
+            path << "test_" << std::setw(4) << std::setfill('0') << frame.index << ".png";
+            export_image(image, image_size, path.str(), THREAD_COUNT);
+        });
+#elif TIME_BUDGET_TEST
+        const budgeted_render render = renderer.render_scene_within(plan, std::chrono::seconds{ 60 });
+        export_image(render.pixels, image_size, "test.png", THREAD_COUNT);
+#elif PREVIEW_TEST
+        static std::atomic<bool> cancelled = false;
+        std::thread{ [] { std::cin.get(); cancelled = true; } }.detach();
+        std::cout << "Press Enter to stop refining the preview." << std::endl;
+        renderer.render_preview(plan, cancelled, [&](const std::vector<rgba>& image, const preview_update&) {
+            export_image(image, image_size, "test.ppm", THREAD_COUNT);
+        });
+#elif BANDED_OUTPUT_TEST
+        renderer.render_scene_to_file(plan, "test.png", 64);
 #else
         const std::vector<rgba> image = renderer.render_scene(plan);
-        export_image(image, image_size, "test.png");
+        export_image(image, image_size, "test.png", THREAD_COUNT);
+#endif
+#if TEXTURE_PAGE_BUDGET_MB
+        texture_pages->print_stats();
 #endif
     }
     catch (const std::exception& e)
@@ -0,0 +1,339 @@
+// Deflate stream format: RFC 1951, zlib wrapper: RFC 1950.
+// Every chunk is a single block compressed with the fixed Huffman codes, which is the same trade-off
+// stb_image_write makes, but the chunks are compressed in parallel and may reference the data
+// preceding them, like pigz does.
+
+#include <output/deflate.hpp>
+
+#include <util/parallel.hpp>
+
+#include <algorithm>
+#include <array>
+
+static constexpr uint32_t window_size = 32768;
+static constexpr uint32_t hash_bits = 15;
+static constexpr uint32_t min_match_length = 3;
+static constexpr uint32_t max_match_length = 258;
+static constexpr uint32_t max_chain_length = 32;
+static constexpr size_t min_chunk_size = 256 * 1024;
+
+// Checksums
+
+uint32_t adler32(const uint8_t* in_data, size_t in_size, const uint32_t in_adler)
+{
+    constexpr uint32_t base = 65521;
+    constexpr size_t max_run = 5552;
+
+    uint32_t a = in_adler & 0xFFFF;
+    uint32_t b = in_adler >> 16;
+    while (in_size > 0)
+    {
+        const size_t run = std::min(in_size, max_run);
+        for (size_t i = 0; i < run; ++i)
+        {
+            a += in_data[i];
+            b += a;
+        }
+        a %= base;
+        b %= base;
+        in_data += run;
+        in_size -= run;
+    }
+    return (b << 16) | a;
+}
+
+uint32_t adler32_combine(const uint32_t in_first_adler, const uint32_t in_second_adler, const size_t in_second_size)
+{
+    constexpr uint32_t base = 65521;
+
+    const uint32_t remainder = uint32_t(in_second_size % base);
+    uint32_t a = in_first_adler & 0xFFFF;
+    uint32_t b = uint32_t((uint64_t(remainder) * a) % base);
+    a += (in_second_adler & 0xFFFF) + base - 1;
+    b += (in_first_adler >> 16) + (in_second_adler >> 16) + base - remainder;
+    if (a >= base) a -= base;
+    if (a >= base) a -= base;
+    if (b >= (base << 1)) b -= (base << 1);
+    if (b >= base) b -= base;
+    return (b << 16) | a;
+}
+
+uint32_t crc32(const uint8_t* in_data, const size_t in_size, const uint32_t in_crc)
+{
+    static const std::array<uint32_t, 256> table = []
+    {
+        std::array<uint32_t, 256> entries;
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (uint32_t k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+        return entries;
+    }();
+
+    uint32_t crc = ~in_crc;
+    for (size_t i = 0; i < in_size; ++i)
+    {
+        crc = table[(crc ^ in_data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Compression
+
+class bit_writer
+{
+public:
+    void put(const uint32_t in_bits, const uint32_t in_count)
+    {
+        this->bit_buffer |= in_bits << this->bit_count;
+        this->bit_count += in_count;
+        while (this->bit_count >= 8)
+        {
+            this->bytes.push_back(uint8_t(this->bit_buffer));
+            this->bit_buffer >>= 8;
+            this->bit_count -= 8;
+        }
+    }
+
+    void align()
+    {
+        if (this->bit_count > 0)
+        {
+            this->put(0, 8 - this->bit_count);
+        }
+    }
+
+    std::vector<uint8_t> bytes;
+
+private:
+    uint32_t bit_buffer = 0;
+    uint32_t bit_count = 0;
+};
+
+struct huffman_code
+{
+    uint16_t bits;
+    uint16_t length;
+};
+
+static uint32_t floor_log2(uint32_t in_value)
+{
+    uint32_t log = 0;
+    while (in_value >>= 1)
+    {
+        ++log;
+    }
+    return log;
+}
+
+static uint16_t reverse_bits(uint32_t in_code, const uint32_t in_length)
+{
+    uint32_t reversed = 0;
+    for (uint32_t i = 0; i < in_length; ++i)
+    {
+        reversed = (reversed << 1) | (in_code & 1);
+        in_code >>= 1;
+    }
+    return uint16_t(reversed);
+}
+
+static const std::array<huffman_code, 288>& fixed_literal_length_codes()
+{
+    static const std::array<huffman_code, 288> codes = []
+    {
+        std::array<huffman_code, 288> entries;
+        for (uint32_t symbol = 0; symbol < 288; ++symbol)
+        {
+            if (symbol <= 143)      entries[symbol] = { reverse_bits(0x30 + symbol, 8), 8 };
+            else if (symbol <= 255) entries[symbol] = { reverse_bits(0x190 + symbol - 144, 9), 9 };
+            else if (symbol <= 279) entries[symbol] = { reverse_bits(symbol - 256, 7), 7 };
+            else                    entries[symbol] = { reverse_bits(0xC0 + symbol - 280, 8), 8 };
+        }
+        return entries;
+    }();
+    return codes;
+}
+
+static void put_literal_length_symbol(bit_writer& out_writer, const uint32_t in_symbol)
+{
+    const huffman_code code = fixed_literal_length_codes()[in_symbol];
+    out_writer.put(code.bits, code.length);
+}
+
+static void put_match(bit_writer& out_writer, const uint32_t in_length, const uint32_t in_distance)
+{
+    if (in_length == max_match_length)
+    {
+        put_literal_length_symbol(out_writer, 285);
+    }
+    else if (const uint32_t length = in_length - min_match_length; length < 8)
+    {
+        put_literal_length_symbol(out_writer, 257 + length);
+    }
+    else
+    {
+        const uint32_t log = floor_log2(length);
+        const uint32_t extra_bits = log - 2;
+        put_literal_length_symbol(out_writer, 257 + (4 * (log - 1)) + ((length >> extra_bits) & 3));
+        out_writer.put(length & ((1u << extra_bits) - 1), extra_bits);
+    }
+
+    if (const uint32_t distance = in_distance - 1; distance < 4)
+    {
+        out_writer.put(reverse_bits(distance, 5), 5);
+    }
+    else
+    {
+        const uint32_t log = floor_log2(distance);
+        const uint32_t extra_bits = log - 1;
+        out_writer.put(reverse_bits((2 * log) + ((distance >> extra_bits) & 1), 5), 5);
+        out_writer.put(distance & ((1u << extra_bits) - 1), extra_bits);
+    }
+}
+
+static uint32_t hash_3_bytes(const uint8_t* in_bytes)
+{
+    const uint32_t value = (uint32_t(in_bytes[0]) << 16) | (uint32_t(in_bytes[1]) << 8) | uint32_t(in_bytes[2]);
+    return (value * 2654435761u) >> (32 - hash_bits);
+}
+
+// Compresses [begin, end) of the data, allowing matches that start up to a window before begin.
+static std::vector<uint8_t> deflate_chunk(const uint8_t* in_data, const size_t in_begin, const size_t in_end,
+    const bool in_is_final)
+{
+    std::vector<int32_t> head(size_t(1) << hash_bits, -1);
+    std::vector<int32_t> previous(window_size, -1);
+    const auto insert = [&](const size_t position)
+    {
+        if (position + min_match_length <= in_end)
+        {
+            int32_t& bucket = head[hash_3_bytes(in_data + position)];
+            previous[position & (window_size - 1)] = bucket;
+            bucket = int32_t(position);
+        }
+    };
+
+    for (size_t i = in_begin - std::min<size_t>(in_begin, window_size); i < in_begin; ++i)
+    {
+        insert(i);
+    }
+
+    bit_writer writer;
+    writer.bytes.reserve((in_end - in_begin) / 2);
+    writer.put(in_is_final ? 1 : 0, 1);
+    writer.put(1, 2);
+
+    size_t i = in_begin;
+    while (i < in_end)
+    {
+        uint32_t best_length = 0;
+        uint32_t best_distance = 0;
+        if (i + min_match_length <= in_end)
+        {
+            const size_t length_limit = std::min<size_t>(max_match_length, in_end - i);
+            int32_t candidate = head[hash_3_bytes(in_data + i)];
+            for (uint32_t chain = 0;
+                candidate >= 0 && i - size_t(candidate) <= window_size && chain < max_chain_length;
+                ++chain, candidate = previous[size_t(candidate) & (window_size - 1)])
+            {
+                const uint8_t* match = in_data + candidate;
+                size_t length = 0;
+                while (length < length_limit && match[length] == in_data[i + length])
+                {
+                    ++length;
+                }
+                if (length > best_length)
+                {
+                    best_length = uint32_t(length);
+                    best_distance = uint32_t(i - size_t(candidate));
+                    if (length == length_limit)
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (best_length >= min_match_length)
+        {
+            put_match(writer, best_length, best_distance);
+            for (size_t j = i; j < i + best_length; ++j)
+            {
+                insert(j);
+            }
+            i += best_length;
+        }
+        else
+        {
+            put_literal_length_symbol(writer, in_data[i]);
+            insert(i);
+            ++i;
+        }
+    }
+    put_literal_length_symbol(writer, 256);
+
+    if (!in_is_final)
+    {
+        // Empty stored block, which leaves the stream byte-aligned for the next chunk.
+        writer.put(0, 3);
+        writer.align();
+        writer.bytes.insert(writer.bytes.end(), { 0x00, 0x00, 0xFF, 0xFF });
+    }
+    writer.align();
+    return std::move(writer.bytes);
+}
+
+deflated_data deflate_parallel(const uint8_t* in_data, const size_t in_size, const bool in_is_final,
+    const uint32_t in_thread_count)
+{
+    const size_t chunk_count = std::max<size_t>(1, std::min<size_t>(in_thread_count, in_size / min_chunk_size));
+
+    std::vector<std::vector<uint8_t>> chunks(chunk_count);
+    std::vector<uint32_t> chunk_adlers(chunk_count);
+    parallel_for(chunk_count, in_thread_count, [&](const size_t first_chunk, const size_t last_chunk)
+    {
+        for (size_t c = first_chunk; c < last_chunk; ++c)
+        {
+            const size_t begin = in_size * c / chunk_count;
+            const size_t end = in_size * (c + 1) / chunk_count;
+            chunks[c] = deflate_chunk(in_data, begin, end, in_is_final && c == chunk_count - 1);
+            chunk_adlers[c] = adler32(in_data + begin, end - begin);
+        }
+    });
+
+    deflated_data deflated{ {}, 1 };
+    size_t compressed_size = 0;
+    for (const std::vector<uint8_t>& chunk : chunks)
+    {
+        compressed_size += chunk.size();
+    }
+    deflated.bytes.reserve(compressed_size);
+    for (size_t c = 0; c < chunk_count; ++c)
+    {
+        deflated.bytes.insert(deflated.bytes.end(), chunks[c].begin(), chunks[c].end());
+        const size_t chunk_size = (in_size * (c + 1) / chunk_count) - (in_size * c / chunk_count);
+        deflated.adler = adler32_combine(deflated.adler, chunk_adlers[c], chunk_size);
+    }
+    return deflated;
+}
+
+std::vector<uint8_t> zlib_compress(const uint8_t* in_data, const size_t in_size, const uint32_t in_thread_count)
+{
+    const deflated_data deflated = deflate_parallel(in_data, in_size, true, in_thread_count);
+
+    std::vector<uint8_t> bytes;
+    bytes.reserve(deflated.bytes.size() + 6);
+    bytes.push_back(0x78);
+    bytes.push_back(0x01);
+    bytes.insert(bytes.end(), deflated.bytes.begin(), deflated.bytes.end());
+    for (int32_t shift = 24; shift >= 0; shift -= 8)
+    {
+        bytes.push_back(uint8_t(deflated.adler >> shift));
+    }
+    return bytes;
+}
\ No newline at end of file
@@ -0,0 +1,392 @@
+#include <output/image_writer.hpp>
+
+#include <output/deflate.hpp>
+#include <util/parallel.hpp>
+#include <util/string.hpp>
+
+#include <external/stb_image_write.h>
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace std::string_literals;
+
+image_format image_format_of(const std::string_view in_path)
+{
+    if (string_ends_with(in_path, ".jpg")) return image_format::jpg;
+    if (string_ends_with(in_path, ".png")) return image_format::png;
+    if (string_ends_with(in_path, ".ppm")) return image_format::ppm;
+    if (string_ends_with(in_path, ".qoi")) return image_format::qoi;
+
+    const size_t last_dot_pos = in_path.find_last_of('.');
+    const std::string_view format = in_path.substr(last_dot_pos + 1, in_path.size() - last_dot_pos - 1);
+    throw std::runtime_error("Unsupported image format: "s + std::string{ format });
+}
+
+static void append_big_endian(std::vector<uint8_t>& out_bytes, const uint32_t in_value)
+{
+    for (int32_t shift = 24; shift >= 0; shift -= 8)
+    {
+        out_bytes.push_back(uint8_t(in_value >> shift));
+    }
+}
+
+image_writer::image_writer(const std::string_view in_path, const extent_2D<uint32_t>& in_image_size,
+    const uint32_t in_thread_count)
+    : path(in_path)
+    , format(image_format_of(in_path))
+    , image_size(in_image_size)
+    , thread_count(std::max<uint32_t>(in_thread_count, 1))
+{
+    if (this->format != image_format::jpg)
+    {
+        this->file.open(this->path, std::ios::binary);
+        if (!this->file)
+        {
+            throw std::runtime_error("Cannot open file '"s + this->path + "' for writing.");
+        }
+    }
+
+    switch (this->format)
+    {
+        case image_format::jpg: this->jpg_rows.reserve(size_t(in_image_size.width) * in_image_size.height); break;
+        case image_format::png: this->write_png_header(); break;
+        case image_format::ppm: this->write_ppm_header(); break;
+        case image_format::qoi: this->write_qoi_header(); break;
+    }
+    this->check_file();
+}
+
+void image_writer::write_rows(const rgba* in_rows, const uint32_t in_row_count)
+{
+    if (this->written_row_count + in_row_count > this->image_size.height)
+    {
+        throw std::runtime_error("Writing more rows than the image '"s + this->path + "' has.");
+    }
+
+    switch (this->format)
+    {
+        case image_format::jpg:
+            this->jpg_rows.insert(this->jpg_rows.end(), in_rows, in_rows + (size_t(in_row_count) * this->image_size.width));
+            break;
+        case image_format::png: this->write_png_rows(in_rows, in_row_count); break;
+        case image_format::ppm: this->write_ppm_rows(in_rows, in_row_count); break;
+        case image_format::qoi: this->write_qoi_rows(in_rows, in_row_count); break;
+    }
+    this->check_file();
+    this->written_row_count += in_row_count;
+}
+
+void image_writer::finish()
+{
+    if (this->written_row_count != this->image_size.height)
+    {
+        throw std::runtime_error("Image '"s + this->path + "' is missing rows.");
+    }
+
+    switch (this->format)
+    {
+        case image_format::jpg:
+        {
+            constexpr uint32_t channels = 4;
+            constexpr int32_t quality = 100;
+            if (!stbi_write_jpg(this->path.c_str(), this->image_size.width, this->image_size.height, channels,
+                this->jpg_rows.data(), quality))
+            {
+                throw std::runtime_error("Could not write to file '"s + this->path + "'.");
+            }
+            return;
+        }
+        case image_format::png: this->finish_png(); break;
+        case image_format::ppm: break;
+        case image_format::qoi: this->finish_qoi(); break;
+    }
+    this->file.close();
+    this->check_file();
+}
+
+// Buffered bytes may only fail to write when they are flushed, so this is checked again after closing.
+void image_writer::check_file() const
+{
+    if (this->format != image_format::jpg && !this->file)
+    {
+        throw std::runtime_error("Could not write to file '"s + this->path + "'.");
+    }
+}
+
+// PNG
+
+static uint8_t paeth_predictor(const int32_t in_left, const int32_t in_up, const int32_t in_up_left)
+{
+    const int32_t estimate = in_left + in_up - in_up_left;
+    const int32_t to_left = std::abs(estimate - in_left);
+    const int32_t to_up = std::abs(estimate - in_up);
+    const int32_t to_up_left = std::abs(estimate - in_up_left);
+    if (to_left <= to_up && to_left <= to_up_left)
+    {
+        return uint8_t(in_left);
+    }
+    return uint8_t(to_up <= to_up_left ? in_up : in_up_left);
+}
+
+// Picks the filter with the smallest sum of absolute differences, the same heuristic libpng uses.
+static void filter_png_row(const uint8_t* in_row, const uint8_t* in_previous_row, const size_t in_row_size,
+    uint8_t* out_filtered_row)
+{
+    constexpr size_t bytes_per_pixel = 4;
+    const auto predict = [&](const uint32_t filter, const size_t i) -> uint8_t
+    {
+        const int32_t left = i >= bytes_per_pixel ? in_row[i - bytes_per_pixel] : 0;
+        const int32_t up = in_previous_row ? in_previous_row[i] : 0;
+        const int32_t up_left = (in_previous_row && i >= bytes_per_pixel) ? in_previous_row[i - bytes_per_pixel] : 0;
+        switch (filter)
+        {
+            case 1: return uint8_t(left);
+            case 2: return uint8_t(up);
+            case 3: return uint8_t((left + up) / 2);
+            case 4: return paeth_predictor(left, up, up_left);
+            default: return 0;
+        }
+    };
+
+    uint32_t best_filter = 0;
+    uint64_t best_cost = ~uint64_t(0);
+    for (uint32_t filter = 0; filter < 5; ++filter)
+    {
+        uint64_t cost = 0;
+        for (size_t i = 0; i < in_row_size; ++i)
+        {
+            cost += std::abs(int32_t(int8_t(uint8_t(in_row[i] - predict(filter, i)))));
+        }
+        if (cost < best_cost)
+        {
+            best_cost = cost;
+            best_filter = filter;
+        }
+    }
+
+    out_filtered_row[0] = uint8_t(best_filter);
+    for (size_t i = 0; i < in_row_size; ++i)
+    {
+        out_filtered_row[i + 1] = uint8_t(in_row[i] - predict(best_filter, i));
+    }
+}
+
+void image_writer::write_png_header()
+{
+    static constexpr uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    this->file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    std::vector<uint8_t> header;
+    append_big_endian(header, this->image_size.width);
+    append_big_endian(header, this->image_size.height);
+    header.insert(header.end(), {
+        8, // bit depth
+        6, // RGBA
+        0, // deflate compression
+        0, // adaptive filtering
+        0, // no interlacing
+    });
+    this->write_png_chunk("IHDR", header.data(), header.size());
+
+    static constexpr uint8_t zlib_header[] = { 0x78, 0x01 };
+    this->write_png_chunk("IDAT", zlib_header, sizeof(zlib_header));
+}
+
+void image_writer::write_png_chunk(const char (&in_type)[5], const uint8_t* in_data, size_t in_size)
+{
+    constexpr size_t max_chunk_size = size_t(1) << 30;
+    do
+    {
+        const size_t chunk_size = std::min(in_size, max_chunk_size);
+
+        std::vector<uint8_t> length;
+        append_big_endian(length, uint32_t(chunk_size));
+        uint32_t crc = crc32(reinterpret_cast<const uint8_t*>(in_type), 4);
+        crc = crc32(in_data, chunk_size, crc);
+        std::vector<uint8_t> checksum;
+        append_big_endian(checksum, crc);
+
+        this->file.write(reinterpret_cast<const char*>(length.data()), length.size());
+        this->file.write(in_type, 4);
+        this->file.write(reinterpret_cast<const char*>(in_data), chunk_size);
+        this->file.write(reinterpret_cast<const char*>(checksum.data()), checksum.size());
+
+        in_data += chunk_size;
+        in_size -= chunk_size;
+    }
+    while (in_size > 0);
+}
+
+void image_writer::write_png_rows(const rgba* in_rows, const uint32_t in_row_count)
+{
+    const size_t row_size = size_t(this->image_size.width) * sizeof(rgba);
+    const uint8_t* row_bytes = reinterpret_cast<const uint8_t*>(in_rows);
+
+    std::vector<uint8_t> filtered(in_row_count * (row_size + 1));
+    parallel_for(in_row_count, this->thread_count, [&](const size_t begin, const size_t end)
+    {
+        for (size_t r = begin; r < end; ++r)
+        {
+            const uint8_t* previous_row = r > 0
+                ? row_bytes + ((r - 1) * row_size)
+                : (this->png.previous_row.empty() ? nullptr : this->png.previous_row.data());
+            filter_png_row(row_bytes + (r * row_size), previous_row, row_size, filtered.data() + (r * (row_size + 1)));
+        }
+    });
+
+    const bool is_last_band = this->written_row_count + in_row_count == this->image_size.height;
+    const deflated_data deflated = deflate_parallel(filtered.data(), filtered.size(), is_last_band, this->thread_count);
+    this->png.adler = adler32_combine(this->png.adler, deflated.adler, filtered.size());
+    this->write_png_chunk("IDAT", deflated.bytes.data(), deflated.bytes.size());
+
+    if (in_row_count > 0)
+    {
+        const uint8_t* last_row = row_bytes + ((in_row_count - 1) * row_size);
+        this->png.previous_row.assign(last_row, last_row + row_size);
+    }
+}
+
+void image_writer::finish_png()
+{
+    if (this->image_size.height == 0)
+    {
+        const deflated_data deflated = deflate_parallel(nullptr, 0, true, 1);
+        this->write_png_chunk("IDAT", deflated.bytes.data(), deflated.bytes.size());
+    }
+
+    std::vector<uint8_t> zlib_footer;
+    append_big_endian(zlib_footer, this->png.adler);
+    this->write_png_chunk("IDAT", zlib_footer.data(), zlib_footer.size());
+    this->write_png_chunk("IEND", nullptr, 0);
+}
+
+// PPM
+
+void image_writer::write_ppm_header()
+{
+    this->file << "P6\n" << this->image_size.width << " " << this->image_size.height << "\n255\n";
+}
+
+void image_writer::write_ppm_rows(const rgba* in_rows, const uint32_t in_row_count)
+{
+    const size_t pixel_count = size_t(in_row_count) * this->image_size.width;
+    std::vector<rgb> pixels(pixel_count);
+    for (size_t i = 0; i < pixel_count; ++i)
+    {
+        pixels[i] = rgb{ in_rows[i].r, in_rows[i].g, in_rows[i].b };
+    }
+    this->file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * sizeof(rgb));
+}
+
+// QOI, https://qoiformat.org/qoi-specification.pdf
+
+static constexpr uint8_t qoi_op_index = 0x00;
+static constexpr uint8_t qoi_op_diff = 0x40;
+static constexpr uint8_t qoi_op_luma = 0x80;
+static constexpr uint8_t qoi_op_run = 0xC0;
+static constexpr uint8_t qoi_op_rgb = 0xFE;
+static constexpr uint8_t qoi_op_rgba = 0xFF;
+static constexpr uint32_t qoi_max_run = 62;
+
+void image_writer::write_qoi_header()
+{
+    std::vector<uint8_t> header = { 'q', 'o', 'i', 'f' };
+    append_big_endian(header, this->image_size.width);
+    append_big_endian(header, this->image_size.height);
+    header.push_back(4); // RGBA
+    header.push_back(0); // sRGB with linear alpha
+    this->file.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+    this->qoi.seen.fill(rgba{ 0, 0, 0, 0 });
+}
+
+void image_writer::write_qoi_rows(const rgba* in_rows, const uint32_t in_row_count)
+{
+    const size_t pixel_count = size_t(in_row_count) * this->image_size.width;
+    std::vector<uint8_t> bytes;
+    bytes.reserve(pixel_count * 2);
+
+    for (size_t i = 0; i < pixel_count; ++i)
+    {
+        const rgba pixel = in_rows[i];
+        if (pixel == this->qoi.previous)
+        {
+            if (++this->qoi.run == qoi_max_run)
+            {
+                bytes.push_back(uint8_t(qoi_op_run | (this->qoi.run - 1)));
+                this->qoi.run = 0;
+            }
+            continue;
+        }
+
+        if (this->qoi.run > 0)
+        {
+            bytes.push_back(uint8_t(qoi_op_run | (this->qoi.run - 1)));
+            this->qoi.run = 0;
+        }
+
+        const size_t index = ((pixel.r * 3) + (pixel.g * 5) + (pixel.b * 7) + (pixel.a * 11)) % 64;
+        if (this->qoi.seen[index] == pixel)
+        {
+            bytes.push_back(uint8_t(qoi_op_index | index));
+        }
+        else
+        {
+            this->qoi.seen[index] = pixel;
+            if (pixel.a == this->qoi.previous.a)
+            {
+                const int32_t dr = int8_t(uint8_t(pixel.r - this->qoi.previous.r));
+                const int32_t dg = int8_t(uint8_t(pixel.g - this->qoi.previous.g));
+                const int32_t db = int8_t(uint8_t(pixel.b - this->qoi.previous.b));
+                const int32_t dr_dg = dr - dg;
+                const int32_t db_dg = db - dg;
+
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    bytes.push_back(uint8_t(qoi_op_diff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+                }
+                else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+                {
+                    bytes.push_back(uint8_t(qoi_op_luma | (dg + 32)));
+                    bytes.push_back(uint8_t(((dr_dg + 8) << 4) | (db_dg + 8)));
+                }
+                else
+                {
+                    bytes.insert(bytes.end(), { qoi_op_rgb, pixel.r, pixel.g, pixel.b });
+                }
+            }
+            else
+            {
+                bytes.insert(bytes.end(), { qoi_op_rgba, pixel.r, pixel.g, pixel.b, pixel.a });
+            }
+        }
+        this->qoi.previous = pixel;
+    }
+    this->file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+void image_writer::finish_qoi()
+{
+    std::vector<uint8_t> bytes;
+    if (this->qoi.run > 0)
+    {
+        bytes.push_back(uint8_t(qoi_op_run | (this->qoi.run - 1)));
+    }
+    bytes.insert(bytes.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+    this->file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+// Whole images
+
+void export_image(const std::vector<rgba>& in_image, const extent_2D<uint32_t>& in_image_size,
+    const std::string_view in_path, const uint32_t in_thread_count)
+{
+    std::cout << "Writing to file... ";
+
+    image_writer writer{ in_path, in_image_size, in_thread_count };
+    writer.write_rows(in_image.data(), in_image_size.height);
+    writer.finish();
+
+    std::cout << "Done." << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#include <render_objects/animation.hpp>
+
+animation_frame animation::frame(const uint32_t in_index) const
+{
+    const float frame_duration = 1.f / this->frame_rate;
+    const float start = float(in_index) * frame_duration;
+    return animation_frame{ in_index, { start, start + (this->shutter * frame_duration) } };
+}
+
+bool animation::is_empty() const
+{
+    return this->frame_count == 0 || !this->animate_camera;
+}
\ No newline at end of file
@@ -9,6 +9,7 @@ camera::camera(const camera_create_info& info)
     , u(glm::normalize(glm::cross(info.up, this->w)))
     , v(glm::cross(this->w, this->u))
     , lens_radius(info.aperture * 0.5f)
+    , vertical_fov(glm::radians(info.vertical_fov))
     , time(info.time)
 {
     const float half_height = glm::tan(glm::radians(info.vertical_fov) * 0.5f);
@@ -13,8 +13,11 @@
 #include <render_objects/hierarchy.hpp>
 #include <util/numeric.hpp>
 #include <util/pairs.hpp>
+#include <util/parallel.hpp>
 
 #include <algorithm>
+#include <thread>
+#include <unordered_map>
 
 // Construction
 
@@ -32,27 +35,29 @@ static BIH_node_type choose_split_axis(const axis_aligned_box& in_box)
     return BIH_node_type::z;
 }
 
-static axis_aligned_box calculate_bounds(const std::vector<shape>& in_shapes)
+static axis_aligned_box shape_bounding_box(const shape& in_shape)
 {
-    axis_aligned_box scene_bounds = in_shapes.front().bounding_box;
+    return in_shape.bounding_box;
+}
 
-    std::for_each(std::next(in_shapes.cbegin()), in_shapes.cend(), [&](const shape& s)
+template <typename T, typename box_getter>
+static axis_aligned_box calculate_bounds(const T* in_begin, const T* in_end, const box_getter& in_box_of)
+{
+    axis_aligned_box bounds = axis_aligned_box::empty();
+    std::for_each(in_begin, in_end, [&](const T& element)
     {
-        scene_bounds.min.x = std::min(s.bounding_box.min.x, scene_bounds.min.x);
-        scene_bounds.min.y = std::min(s.bounding_box.min.y, scene_bounds.min.y);
-        scene_bounds.min.z = std::min(s.bounding_box.min.z, scene_bounds.min.z);
-        scene_bounds.max.x = std::max(s.bounding_box.max.x, scene_bounds.max.x);
-        scene_bounds.max.y = std::max(s.bounding_box.max.y, scene_bounds.max.y);
-        scene_bounds.max.z = std::max(s.bounding_box.max.z, scene_bounds.max.z);
+        bounds.extend(in_box_of(element));
     });
-
-    return scene_bounds;
+    return bounds;
 }
 
+template <typename T, typename box_getter>
 static BIH_node_type split(
-    const iterator_pair<std::vector<shape>>& in_shapes,
+    T* in_begin,
+    T* in_end,
+    const box_getter& in_box_of,
     BIH_node& out_current_node,
-    std::vector<shape>::iterator& out_middle,
+    T*& out_middle,
     axis_aligned_box& out_left_box,
     axis_aligned_box& out_right_box
 ) {
@@ -61,21 +66,21 @@ static BIH_node_type split(
         it < 3;
         ++it, axis = (axis + 1) % 3
     ) {
-        const auto is_to_the_left = [axis, in_split_plane = out_left_box.origin()[axis]]
-            (const shape& a) { return a.bounding_box.origin()[axis] < in_split_plane; };
-        out_middle = std::partition(in_shapes.begin, in_shapes.end, is_to_the_left);
+        const auto is_to_the_left = [&in_box_of, axis, in_split_plane = out_left_box.origin()[axis]]
+            (const T& a) { return in_box_of(a).origin()[axis] < in_split_plane; };
+        out_middle = std::partition(in_begin, in_end, is_to_the_left);
 
-        if (out_middle != in_shapes.begin && out_middle != in_shapes.end)
+        if (out_middle != in_begin && out_middle != in_end)
         {
-            const auto compare_max = [=](const shape& a, const shape& b) { return a.bounding_box.max[axis] < b.bounding_box.max[axis]; };
-            const auto compare_min = [=](const shape& a, const shape& b) { return a.bounding_box.min[axis] < b.bounding_box.min[axis]; };
-            const std::vector<shape>::iterator max_left = std::max_element(in_shapes.begin, out_middle, compare_max);
-            const std::vector<shape>::iterator min_right = std::min_element(out_middle, in_shapes.end, compare_min);
+            const auto compare_max = [&in_box_of, axis](const T& a, const T& b) { return in_box_of(a).max[axis] < in_box_of(b).max[axis]; };
+            const auto compare_min = [&in_box_of, axis](const T& a, const T& b) { return in_box_of(a).min[axis] < in_box_of(b).min[axis]; };
+            const axis_aligned_box max_left = in_box_of(*std::max_element(in_begin, out_middle, compare_max));
+            const axis_aligned_box min_right = in_box_of(*std::min_element(out_middle, in_end, compare_min));
 
-            out_left_box.max[axis] = max_left->bounding_box.min[axis];
-            out_right_box.min[axis] = min_right->bounding_box.max[axis];
-            out_current_node.clip.left = max_left->bounding_box.max[axis];
-            out_current_node.clip.right = min_right->bounding_box.min[axis];
+            out_left_box.max[axis] = max_left.min[axis];
+            out_right_box.min[axis] = min_right.max[axis];
+            out_current_node.clip.left = max_left.max[axis];
+            out_current_node.clip.right = min_right.min[axis];
 
             return out_current_node.type = BIH_node_type{ axis };
         }
@@ -83,49 +88,346 @@ static BIH_node_type split(
     return BIH_node_type::leaf;
 }
 
+template <typename T, typename box_getter>
 static void make_hierarchy(
-    const iterator_pair<std::vector<shape>>& in_shapes,
-    std::vector<shape>& in_shapes_container,
+    T* in_begin,
+    T* in_end,
+    const T* in_first,
+    const box_getter& in_box_of,
+    const uint32_t in_leaf_size,
     const axis_aligned_box& in_node_bounds,
     const array_index in_current,
-    bounding_interval_hierarchy& out_nodes
+    std::vector<BIH_node, aligned_allocator<BIH_node>>& out_nodes
 ) {
-    const ptrdiff_t shape_count = std::distance(in_shapes.begin, in_shapes.end);
-    if (shape_count < 1)
+    const ptrdiff_t count = std::distance(in_begin, in_end);
+    if (count < 1)
     {
         return;
     }
-    if (shape_count > 1)
+    if (count > ptrdiff_t(in_leaf_size))
     {
-        std::vector<shape>::iterator middle = in_shapes.end;
+        T* middle = in_end;
         axis_aligned_box left_box = in_node_bounds;
         axis_aligned_box right_box = in_node_bounds;
 
-        if (split(in_shapes, out_nodes[in_current], middle, left_box, right_box) != BIH_node_type::leaf)
+        if (split(in_begin, in_end, in_box_of, out_nodes[in_current], middle, left_box, right_box) != BIH_node_type::leaf)
         {
             out_nodes.push_back(BIH_node{ BIH_node_type::leaf });
             out_nodes.push_back(BIH_node{ BIH_node_type::leaf });
             out_nodes[in_current].children.left = out_nodes.size() - 2;
             out_nodes[in_current].children.right = out_nodes.size() - 1;
-            make_hierarchy({ in_shapes.begin, middle }, in_shapes_container, left_box, out_nodes[in_current].children.left, out_nodes);
-            make_hierarchy({ middle, in_shapes.end }, in_shapes_container, right_box, out_nodes[in_current].children.right, out_nodes);
+            make_hierarchy(in_begin, middle, in_first, in_box_of, in_leaf_size, left_box, out_nodes[in_current].children.left, out_nodes);
+            make_hierarchy(middle, in_end, in_first, in_box_of, in_leaf_size, right_box, out_nodes[in_current].children.right, out_nodes);
             return;
         }
     }
-    out_nodes[in_current].shape_group.index = std::distance(in_shapes_container.begin(), in_shapes.begin);
-    out_nodes[in_current].shape_group.count = shape_count;
+    out_nodes[in_current].shape_group.index = std::distance(in_first, static_cast<const T*>(in_begin));
+    out_nodes[in_current].shape_group.count = count;
 }
 
-bounding_interval_hierarchy make_hierarchy(std::vector<shape>& in_shapes)
+template <typename T, typename box_getter>
+static bounding_interval_hierarchy make_hierarchy(T* in_elements, const size_t in_count, const box_getter& in_box_of,
+    const uint32_t in_leaf_size)
 {
-    if (in_shapes.empty())
+    if (in_count == 0)
     {
         return {};
     }
 
-    bounding_interval_hierarchy nodes{ BIH_node{ BIH_node_type::leaf } };
-    nodes.reserve(2 * in_shapes.size());
-    make_hierarchy(iterator_pair{ in_shapes }, in_shapes, calculate_bounds(in_shapes), 0, nodes);
+    std::vector<BIH_node, aligned_allocator<BIH_node>> nodes{ BIH_node{ BIH_node_type::leaf } };
+    nodes.reserve((2 * in_count) / in_leaf_size + 1);
+    make_hierarchy(in_elements, in_elements + in_count, in_elements, in_box_of, in_leaf_size,
+        calculate_bounds(in_elements, in_elements + in_count, in_box_of), 0, nodes);
     nodes.shrink_to_fit();
     return nodes;
+}
+
+bounding_interval_hierarchy make_hierarchy(aligned_array<shape>& in_shapes)
+{
+    return make_hierarchy(in_shapes.data(), in_shapes.size(), shape_bounding_box, 1);
+}
+
+bounding_interval_hierarchy make_hierarchy(quantized_mesh_triangle_shape* inout_triangles, const size_t in_count,
+    const quantized_mesh& in_mesh, const quantized_vertex* in_vertices)
+{
+    const auto triangle_bounding_box = [&in_mesh, in_vertices](const quantized_mesh_triangle_shape& in_triangle)
+    {
+        return triangle_shape{ triangle{ in_mesh.unpack_position(in_vertices[in_triangle.indices[0]]),
+            in_mesh.unpack_position(in_vertices[in_triangle.indices[1]]),
+            in_mesh.unpack_position(in_vertices[in_triangle.indices[2]]) } }.bounding_box();
+    };
+    return make_hierarchy(inout_triangles, in_count, triangle_bounding_box, quantized_mesh_leaf_size);
+}
+
+// Refitting
+
+static constexpr float node_visit_cost = 1.f;
+static constexpr float shape_test_cost = 1.f;
+
+struct subtree_refit
+{
+    axis_aligned_box bounds;
+    // Surface area times the cost of every node in the subtree.
+    float weighted_cost;
+    size_t shape_end;
+};
+
+// The boxes of the shapes and the clip planes written are those of the current positions, or of one
+// end of the motion.
+template <typename box_getter, typename clip_getter>
+static subtree_refit refit_subtree(const BIH_node* in_nodes, const shape* in_shapes, const box_getter& in_box_of,
+    const clip_getter& in_clip_of, const uint32_t in_index, const std::unordered_map<uint32_t, subtree_refit>& in_refitted)
+{
+    if (const auto found = in_refitted.find(in_index); found != in_refitted.end())
+    {
+        return found->second;
+    }
+
+    const BIH_node& node = in_nodes[in_index];
+    if (node.type == BIH_node_type::leaf)
+    {
+        subtree_refit leaf{ axis_aligned_box::empty(), 0.f, size_t(node.shape_group.index) + node.shape_group.count };
+        uint32_t shape_count = 0;
+        for (uint32_t i = node.shape_group.index; i < leaf.shape_end; ++i)
+        {
+            if (in_shapes[i].type != shape_type::none)
+            {
+                leaf.bounds.extend(in_box_of(i));
+                ++shape_count;
+            }
+        }
+        leaf.weighted_cost = leaf.bounds.surface_area() * shape_test_cost * float(shape_count);
+        return leaf;
+    }
+
+    const subtree_refit left = refit_subtree(in_nodes, in_shapes, in_box_of, in_clip_of, node.children.left, in_refitted);
+    const subtree_refit right = refit_subtree(in_nodes, in_shapes, in_box_of, in_clip_of, node.children.right, in_refitted);
+    const uint32_t axis = uint32_t(node.type);
+    // Empty children get planes no ray can pass.
+    BIH_clip& clip = in_clip_of(in_index);
+    clip.left = left.bounds.is_empty() ? -infinity<float> : left.bounds.max[axis];
+    clip.right = right.bounds.is_empty() ? infinity<float> : right.bounds.min[axis];
+
+    subtree_refit refit{ left.bounds, left.weighted_cost + right.weighted_cost, std::max(left.shape_end, right.shape_end) };
+    refit.bounds.extend(right.bounds);
+    refit.weighted_cost += refit.bounds.surface_area() * node_visit_cost;
+    return refit;
+}
+
+template <typename box_getter, typename clip_getter>
+static hierarchy_refit refit_nodes(const bounding_interval_hierarchy& in_hierarchy, const aligned_array<shape>& in_shapes,
+    const box_getter& in_box_of, const clip_getter& in_clip_of, const uint32_t in_thread_count)
+{
+    if (in_hierarchy.empty())
+    {
+        return hierarchy_refit{ axis_aligned_box::empty(), 0.f, 0 };
+    }
+
+    // The subtrees below the first levels are refitted on separate threads, then the levels above them.
+    const BIH_node* nodes = in_hierarchy.data();
+    std::vector<uint32_t> subtrees{ 0 };
+    while (subtrees.size() < 4 * size_t(in_thread_count))
+    {
+        std::vector<uint32_t> next_subtrees;
+        for (const uint32_t it_index : subtrees)
+        {
+            if (nodes[it_index].type == BIH_node_type::leaf)
+            {
+                next_subtrees.push_back(it_index);
+            }
+            else
+            {
+                next_subtrees.push_back(nodes[it_index].children.left);
+                next_subtrees.push_back(nodes[it_index].children.right);
+            }
+        }
+        if (next_subtrees.size() == subtrees.size())
+        {
+            break;
+        }
+        subtrees = std::move(next_subtrees);
+    }
+
+    const std::unordered_map<uint32_t, subtree_refit> none_refitted;
+    std::vector<subtree_refit> subtree_refits(subtrees.size());
+    parallel_for(subtrees.size(), in_thread_count, [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
+        {
+            subtree_refits[i] = refit_subtree(nodes, in_shapes.data(), in_box_of, in_clip_of, subtrees[i], none_refitted);
+        }
+    });
+
+    std::unordered_map<uint32_t, subtree_refit> refitted;
+    for (size_t i = 0; i < subtrees.size(); ++i)
+    {
+        refitted.emplace(subtrees[i], subtree_refits[i]);
+    }
+    const subtree_refit root = refit_subtree(nodes, in_shapes.data(), in_box_of, in_clip_of, 0, refitted);
+    const float root_area = root.bounds.surface_area();
+    return hierarchy_refit{ root.bounds, root_area > 0.f ? root.weighted_cost / root_area : 0.f, root.shape_end };
+}
+
+hierarchy_refit refit_hierarchy(bounding_interval_hierarchy& inout_hierarchy, const aligned_array<shape>& in_shapes,
+    const uint32_t in_thread_count)
+{
+    const shape* shapes = in_shapes.data();
+    BIH_node* nodes = inout_hierarchy.data();
+    return refit_nodes(inout_hierarchy, in_shapes,
+        [shapes](const size_t in_shape) -> const axis_aligned_box& { return shapes[in_shape].bounding_box; },
+        [nodes](const uint32_t in_node) -> BIH_clip& { return nodes[in_node].clip; },
+        in_thread_count);
+}
+
+hierarchy_refit refit_hierarchy(bounding_interval_hierarchy& inout_hierarchy, BIH_end_clips& out_end_clips,
+    const aligned_array<shape>& in_shapes, const std::vector<min_max<axis_aligned_box>>& in_motion_bounding_boxes,
+    const uint32_t in_thread_count)
+{
+    const min_max<axis_aligned_box>* boxes = in_motion_bounding_boxes.data();
+    BIH_node* nodes = inout_hierarchy.data();
+    const hierarchy_refit start = refit_nodes(inout_hierarchy, in_shapes,
+        [boxes](const size_t in_shape) -> const axis_aligned_box& { return boxes[in_shape].min; },
+        [nodes](const uint32_t in_node) -> BIH_clip& { return nodes[in_node].clip; },
+        in_thread_count);
+
+    out_end_clips.resize(inout_hierarchy.size());
+    BIH_clip* end_clips = out_end_clips.data();
+    const hierarchy_refit end = refit_nodes(inout_hierarchy, in_shapes,
+        [boxes](const size_t in_shape) -> const axis_aligned_box& { return boxes[in_shape].max; },
+        [end_clips](const uint32_t in_node) -> BIH_clip& { return end_clips[in_node]; },
+        in_thread_count);
+
+    hierarchy_refit refit{ start.bounds, 0.5f * (start.cost + end.cost), start.covered_shape_count };
+    refit.bounds.extend(end.bounds);
+    return refit;
+}
+
+void insert_into_hierarchy(bounding_interval_hierarchy& inout_hierarchy, const aligned_array<shape>& in_shapes,
+    const hierarchy_refit& in_refit)
+{
+    if (in_refit.covered_shape_count >= in_shapes.size())
+    {
+        return;
+    }
+
+    axis_aligned_box added_bounds = axis_aligned_box::empty();
+    for (size_t i = in_refit.covered_shape_count; i < in_shapes.size(); ++i)
+    {
+        added_bounds.extend(in_shapes[i].bounding_box);
+    }
+
+    // The new root splits along the axis the old and the added shapes are furthest apart on.
+    const displacement_3D apart = glm::abs(added_bounds.origin() - in_refit.bounds.origin());
+    const BIH_node_type axis = apart.x > apart.y && apart.x > apart.z ? BIH_node_type::x
+        : apart.y > apart.z ? BIH_node_type::y : BIH_node_type::z;
+
+    BIH_node added{ BIH_node_type::leaf };
+    added.shape_group = { uint32_t(in_refit.covered_shape_count), uint32_t(in_shapes.size() - in_refit.covered_shape_count) };
+    const BIH_node old_root = inout_hierarchy.front();
+    const uint32_t old_root_index = uint32_t(inout_hierarchy.size());
+    const uint32_t added_index = old_root_index + 1;
+    inout_hierarchy.push_back(old_root);
+    inout_hierarchy.push_back(added);
+
+    BIH_node& root = inout_hierarchy.front();
+    root.type = axis;
+    root.clip = { -infinity<float>, infinity<float> };
+    if (added_bounds.origin()[uint32_t(axis)] < in_refit.bounds.origin()[uint32_t(axis)])
+    {
+        root.children = { added_index, old_root_index };
+    }
+    else
+    {
+        root.children = { old_root_index, added_index };
+    }
+}
+
+// Lazy construction
+
+lazy_BIH::lazy_BIH(aligned_array<shape>& in_shapes)
+    : shapes(in_shapes.data())
+{
+    if (in_shapes.empty())
+    {
+        return;
+    }
+
+    // Every split adds two nodes with at least one shape each, so there are fewer than twice as many
+    // nodes as shapes, and the nodes never move while rays read them.
+    const size_t max_node_count = 2 * in_shapes.size();
+    this->nodes.resize(max_node_count, BIH_node{ BIH_node_type::leaf });
+    this->node_bounds.resize(max_node_count);
+    this->states = std::make_unique<std::atomic<uint8_t>[]>(max_node_count);
+    for (size_t i = 0; i < max_node_count; ++i)
+    {
+        this->states[i].store(node_state::unexpanded, std::memory_order_relaxed);
+    }
+
+    this->nodes[0].shape_group.index = 0;
+    this->nodes[0].shape_group.count = uint32_t(in_shapes.size());
+    this->node_bounds[0] = calculate_bounds(in_shapes.cbegin(), in_shapes.cend(), shape_bounding_box);
+}
+
+void lazy_BIH::expand(const uint32_t in_index)
+{
+    uint8_t state = node_state::unexpanded;
+    if (!this->states[in_index].compare_exchange_strong(state, node_state::expanding, std::memory_order_acquire))
+    {
+        while (this->states[in_index].load(std::memory_order_acquire) != node_state::expanded)
+        {
+            std::this_thread::yield();
+        }
+        return;
+    }
+
+    // Unexpanded nodes are leaves holding all shapes under them, split the same way make_hierarchy does.
+    BIH_node& current = this->nodes[in_index];
+    const uint32_t first_shape = current.shape_group.index;
+    const uint32_t shape_count = current.shape_group.count;
+    if (shape_count > 1)
+    {
+        shape* begin = this->shapes + first_shape;
+        shape* end = begin + shape_count;
+        shape* middle = end;
+        axis_aligned_box left_box = this->node_bounds[in_index];
+        axis_aligned_box right_box = this->node_bounds[in_index];
+        if (split(begin, end, shape_bounding_box, current, middle, left_box, right_box) != BIH_node_type::leaf)
+        {
+            const uint32_t left = this->node_count.fetch_add(2);
+            const uint32_t left_count = uint32_t(middle - begin);
+            this->nodes[left].shape_group = { first_shape, left_count };
+            this->nodes[left + 1].shape_group = { first_shape + left_count, shape_count - left_count };
+            this->node_bounds[left] = left_box;
+            this->node_bounds[left + 1] = right_box;
+            current.children.left = left;
+            current.children.right = left + 1;
+        }
+    }
+    this->states[in_index].store(node_state::expanded, std::memory_order_release);
+}
+
+bounding_interval_hierarchy lazy_BIH::expand_all()
+{
+    if (this->nodes.empty())
+    {
+        return {};
+    }
+
+    std::vector<uint32_t> pending{ 0 };
+    while (!pending.empty())
+    {
+        const BIH_node& current = this->node(pending.back());
+        pending.pop_back();
+        if (current.type != BIH_node_type::leaf)
+        {
+            pending.push_back(current.children.right);
+            pending.push_back(current.children.left);
+        }
+    }
+    return std::vector<BIH_node, aligned_allocator<BIH_node>>(this->nodes.begin(), this->nodes.begin() + this->node_count.load());
+}
+
+std::shared_ptr<lazy_BIH> make_lazy_hierarchy(aligned_array<shape>& in_shapes)
+{
+    return std::make_shared<lazy_BIH>(in_shapes);
 }
\ No newline at end of file
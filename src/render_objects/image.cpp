@@ -3,41 +3,256 @@
 #include <util/barycentric.hpp>
 #include <util/interpolation.hpp>
 #include <util/numeric.hpp>
+#include <util/random.hpp>
 #include <util/vector.hpp>
 
+#include <array>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE 1
+#include <emmintrin.h>
+#else
+#define USE_SSE 0
+#endif
+
+// Layout
+
+static size_t level_texel_count(const extent_2D<uint32_t>& in_size, const texel_layout in_layout)
+{
+    switch (in_layout)
+    {
+        case texel_layout::linear:    return size_t(in_size.width) * in_size.height;
+        case texel_layout::tiled_4x4: return ((size_t(in_size.width) + 3) & ~size_t(3)) * ((size_t(in_size.height) + 3) & ~size_t(3));
+    }
+    return 0;
+}
+
+void vector_map::set_layout(const texel_layout in_layout)
+{
+    if (in_layout == this->layout)
+    {
+        return;
+    }
+
+    vector_map converted{ this->size, this->format, in_layout, {}, this->levels };
+    size_t texel_count = 0;
+    for (mip_level& it_level : converted.levels)
+    {
+        it_level.first_texel = texel_count;
+        texel_count += level_texel_count(it_level.size, in_layout);
+    }
+    converted.texels.resize(texel_count * texel_size(this->format));
+
+    const size_t bytes_per_texel = texel_size(this->format);
+    const byte_buffer& source_texels = this->texels;
+    for (size_t l = 0; l < this->levels.size(); ++l)
+    {
+        for (uint32_t y = 0; y < this->levels[l].size.height; ++y)
+        {
+            for (uint32_t x = 0; x < this->levels[l].size.width; ++x)
+            {
+                std::memcpy(
+                    converted.texels.data() + (converted.texel_index(converted.levels[l], x, y) * bytes_per_texel),
+                    source_texels.data() + (this->texel_index(this->levels[l], x, y) * bytes_per_texel),
+                    bytes_per_texel);
+            }
+        }
+    }
+    *this = std::move(converted);
+}
+
+bool vector_map::has_consistent_levels() const
+{
+    const size_t bytes_per_texel = texel_size(this->format);
+    if (bytes_per_texel == 0
+        || (this->layout != texel_layout::linear && this->layout != texel_layout::tiled_4x4)
+        || this->levels.empty()
+        || this->texels.size() % bytes_per_texel != 0)
+    {
+        return false;
+    }
+
+    // Every level is half the size of the one before, rounded down to at least one texel.
+    const size_t texel_count = this->texels.size() / bytes_per_texel;
+    extent_2D<uint32_t> expected_size = this->size;
+    size_t first_texel = 0;
+    for (const mip_level& it_level : this->levels)
+    {
+        if (it_level.size.width == 0 || it_level.size.height == 0
+            || it_level.size.width != expected_size.width || it_level.size.height != expected_size.height
+            || it_level.first_texel != first_texel
+            || size_t(it_level.size.width) > texel_count / it_level.size.height
+            || level_texel_count(it_level.size, this->layout) > texel_count - first_texel)
+        {
+            return false;
+        }
+        first_texel += level_texel_count(it_level.size, this->layout);
+        expected_size = { std::max(1u, expected_size.width / 2), std::max(1u, expected_size.height / 2) };
+    }
+    return first_texel == texel_count;
+}
+
+// Paging
+
+// Pages hold whole 4x4 tiles, 128 tiles per page.
+static constexpr size_t texels_per_page = 128 * 16;
+
+bool vector_map::page_texels(std::shared_ptr<page_cache> in_pages)
+{
+    return this->texels.page(std::move(in_pages), texels_per_page * texel_size(this->format));
+}
+
+// Mip levels
+
+void vector_map::generate_mip_levels()
+{
+    this->levels.resize(1);
+    size_t texel_count = level_texel_count(this->size, this->layout);
+    for (extent_2D<uint32_t> level_size = this->size; level_size.width > 1 || level_size.height > 1;)
+    {
+        level_size = { std::max(1u, level_size.width / 2), std::max(1u, level_size.height / 2) };
+        this->levels.push_back(mip_level{ level_size, texel_count });
+        texel_count += level_texel_count(level_size, this->layout);
+    }
+    this->texels.resize(texel_count * texel_size(this->format));
+
+    // Box filter, odd rows and columns fold into the last texel.
+    for (size_t l = 1; l < this->levels.size(); ++l)
+    {
+        const mip_level& source = this->levels[l - 1];
+        const mip_level& target = this->levels[l];
+        for (uint32_t y = 0; y < target.size.height; ++y)
+        {
+            for (uint32_t x = 0; x < target.size.width; ++x)
+            {
+                const uint32_t first_x = 2 * x, first_y = 2 * y;
+                const uint32_t last_x = (x + 1 == target.size.width) ? source.size.width : std::min(first_x + 2, source.size.width);
+                const uint32_t last_y = (y + 1 == target.size.height) ? source.size.height : std::min(first_y + 2, source.size.height);
+
+                glm::vec3 sum{ 0.f };
+                for (uint32_t sy = first_y; sy < last_y; ++sy)
+                {
+                    for (uint32_t sx = first_x; sx < last_x; ++sx)
+                    {
+                        sum += this->texel(source, sx, sy);
+                    }
+                }
+                const float inverse_count = 1.f / float((last_x - first_x) * (last_y - first_y));
+                this->set_texel(this->texel_index(target, x, y), sum * inverse_count);
+            }
+        }
+    }
+}
+
+uint32_t last_level_of_fragment(const min_max<texture_position_2D>& in_fragment)
+{
+    const float fragment_width = in_fragment.max.s - in_fragment.min.s;
+    const float fragment_height = in_fragment.max.t - in_fragment.min.t;
+    return uint32_t(glm::log2(glm::max(1.f, glm::min(fragment_width, fragment_height))));
+}
+
+// Level sizes are rounded down, so each axis is scaled by how much its level actually shrank.
+static min_max<texture_position_2D> scale_fragment(const min_max<texture_position_2D>& in_fragment,
+    const extent_2D<uint32_t>& in_base_size, const extent_2D<uint32_t>& in_level_size)
+{
+    const texture_position_2D scale = {
+        float(in_level_size.width) / float(in_base_size.width),
+        float(in_level_size.height) / float(in_base_size.height),
+    };
+    return { in_fragment.min * scale, in_fragment.max * scale };
+}
+
+static min_max<texture_position_2D> fragment_at_level(const vector_map& in_image,
+    const min_max<texture_position_2D>& in_fragment, const uint32_t in_level)
+{
+    return scale_fragment(in_fragment, in_image.levels[0].size, in_image.levels[in_level].size);
+}
+
 // Wrapping
 
-static float wrap(const float in_value, const min_max<float>& in_range, const wrap_method in_wrap_method)
+// Repeating a fragment whose size is a power of two, aligned to its size, wraps texels by masking.
+enum class wrap_mode
 {
-    switch (in_wrap_method)
+    clamp_to_border,
+    clamp_to_edge,
+    mirrored_repeat,
+    repeat,
+    repeat_power_of_two,
+};
+
+static constexpr size_t wrap_mode_count = 5;
+
+// The clamping and mirroring methods keep coordinates on the texels of the fragment, repeating uses
+// the size of the fragment as its period.
+template <wrap_mode W>
+static float wrap(const float in_value, const min_max<float>& in_fragment)
+{
+    if constexpr (W == wrap_mode::clamp_to_border)
+    {
+        return is_clamped(in_value, { in_fragment.min, in_fragment.max - 1 }) ? in_value : -1.f;
+    }
+    else if constexpr (W == wrap_mode::clamp_to_edge)
+    {
+        return glm::clamp(in_value, in_fragment.min, in_fragment.max - 1);
+    }
+    else if constexpr (W == wrap_mode::mirrored_repeat)
+    {
+        return mirrored_repeat(in_value, { in_fragment.min, in_fragment.max - 1 });
+    }
+    else
+    {
+        return repeat(in_value, in_fragment);
+    }
+}
+
+// Wraps whole texel coordinates.
+template <wrap_mode W>
+static float wrap_texel(const float in_value, const min_max<float>& in_fragment)
+{
+    if constexpr (W == wrap_mode::repeat_power_of_two)
+    {
+        const int32_t min = int32_t(in_fragment.min);
+        return float(min + ((int32_t(in_value) - min) & (int32_t(in_fragment.max) - min - 1)));
+    }
+    else
     {
-        case wrap_method::clamp_to_border: return is_clamped(in_value, { in_range.min, in_range.max }) ? in_value : -1.f;
-        case wrap_method::clamp_to_edge:   return glm::clamp(in_value, in_range.min, in_range.max);
-        case wrap_method::mirrored_repeat: return mirrored_repeat(in_value, in_range);
-        case wrap_method::repeat:          return repeat(in_value, in_range);
+        return wrap<W>(in_value, in_fragment);
     }
-    return -1.f;
 }
 
-static barycentric_2D wrap(const barycentric_2D& in_mapping, const wrap_method in_wrap_method)
+template <wrap_mode W>
+static barycentric_2D wrap_unit(const barycentric_2D& in_mapping)
 {
-    return barycentric_2D{
-        wrap(in_mapping.U, { 0.f, 1.f - glm::epsilon<float>() }, in_wrap_method),
-        wrap(in_mapping.V, { 0.f, 1.f - glm::epsilon<float>() }, in_wrap_method),
+    const min_max<float> unit_range = { 0.f, 1.f - glm::epsilon<float>() };
+    const auto wrap_unit_value = [&unit_range](const float value) {
+        if constexpr (W == wrap_mode::clamp_to_border) return is_clamped(value, unit_range) ? value : -1.f;
+        else if constexpr (W == wrap_mode::clamp_to_edge) return glm::clamp(value, unit_range.min, unit_range.max);
+        else if constexpr (W == wrap_mode::mirrored_repeat) return mirrored_repeat(value, unit_range);
+        else return repeat(value, unit_range);
     };
+    return barycentric_2D{ wrap_unit_value(in_mapping.U), wrap_unit_value(in_mapping.V) };
 }
 
 // Filtering
 
-static auto pick_4x4_neighbors_and_interpolants(const vector_map& in_sampled_image,
-    const min_max<texture_position_2D>& in_image_fragment, const barycentric_2D& in_mapping,
-    const wrap_method in_wrap_method)
+#if !USE_SSE
+
+template <wrap_mode W, typename T>
+static auto pick_4x4_neighbors_and_interpolants(const T& in_texels,
+    const min_max<texture_position_2D>& in_image_fragment, const barycentric_2D& in_mapping)
 {
     const auto wrap_s_in_fragment = [&](const float s) {
-        return wrap(s, { in_image_fragment.min.s, in_image_fragment.max.s - 1 }, in_wrap_method);
+        return wrap<W>(s, { in_image_fragment.min.s, in_image_fragment.max.s });
     };
     const auto wrap_t_in_fragment = [&](const float t) {
-        return wrap(t, { in_image_fragment.min.t, in_image_fragment.max.t - 1 }, in_wrap_method);
+        return wrap<W>(t, { in_image_fragment.min.t, in_image_fragment.max.t });
+    };
+    const auto wrap_s_texel_in_fragment = [&](const float s) {
+        return wrap_texel<W>(s, { in_image_fragment.min.s, in_image_fragment.max.s });
+    };
+    const auto wrap_t_texel_in_fragment = [&](const float t) {
+        return wrap_texel<W>(t, { in_image_fragment.min.t, in_image_fragment.max.t });
     };
 
     const float fragment_width = in_image_fragment.max.s - in_image_fragment.min.s;
@@ -55,8 +270,8 @@ static auto pick_4x4_neighbors_and_interpolants(const vector_map& in_sampled_ima
     std::array<float, 8> neighbors;
     for (size_t i = 0; i < 4; ++i)
     {
-        neighbors[i + 0] = wrap_s_in_fragment(s_int - 1.f + float(i));
-        neighbors[i + 4] = wrap_t_in_fragment(t_int - 1.f + float(i));
+        neighbors[i + 0] = wrap_s_texel_in_fragment(s_int - 1.f + float(i));
+        neighbors[i + 4] = wrap_t_texel_in_fragment(t_int - 1.f + float(i));
     }
 
     std::array<color, 16> texels;
@@ -71,8 +286,7 @@ static auto pick_4x4_neighbors_and_interpolants(const vector_map& in_sampled_ima
             }
             else
             {
-                const size_t pixel_index = neighbors[s] + (neighbors[t] * in_sampled_image.size.width);
-                texels[texel_index] = in_sampled_image.pixels[pixel_index];
+                texels[texel_index] = in_texels.at(uint32_t(neighbors[s]), uint32_t(neighbors[t]));
             }
         }
     }
@@ -80,15 +294,21 @@ static auto pick_4x4_neighbors_and_interpolants(const vector_map& in_sampled_ima
     return std::make_tuple(texels, s_fract, t_fract);
 }
 
-static auto pick_2x2_neighbors_and_interpolants(const vector_map& in_sampled_image,
-    const min_max<texture_position_2D>& in_image_fragment, const barycentric_2D& in_mapping,
-    const wrap_method in_wrap_method)
+template <wrap_mode W, typename T>
+static auto pick_2x2_neighbors_and_interpolants(const T& in_texels,
+    const min_max<texture_position_2D>& in_image_fragment, const barycentric_2D& in_mapping)
 {
     const auto wrap_s_in_fragment = [&](const float s) {
-        return wrap(s, { in_image_fragment.min.s, in_image_fragment.max.s - 1 }, in_wrap_method);
+        return wrap<W>(s, { in_image_fragment.min.s, in_image_fragment.max.s });
     };
     const auto wrap_t_in_fragment = [&](const float t) {
-        return wrap(t, { in_image_fragment.min.t, in_image_fragment.max.t - 1 }, in_wrap_method);
+        return wrap<W>(t, { in_image_fragment.min.t, in_image_fragment.max.t });
+    };
+    const auto wrap_s_texel_in_fragment = [&](const float s) {
+        return wrap_texel<W>(s, { in_image_fragment.min.s, in_image_fragment.max.s });
+    };
+    const auto wrap_t_texel_in_fragment = [&](const float t) {
+        return wrap_texel<W>(t, { in_image_fragment.min.t, in_image_fragment.max.t });
     };
 
     const float fragment_width = in_image_fragment.max.s - in_image_fragment.min.s;
@@ -103,41 +323,231 @@ static auto pick_2x2_neighbors_and_interpolants(const vector_map& in_sampled_ima
     const float s_fract = glm::modf(texcoord.s, s_int);
     const float t_fract = glm::modf(texcoord.t, t_int);
 
-    const float left = wrap_s_in_fragment(s_int);
-    const float up = wrap_t_in_fragment(t_int);
-    const float right = wrap_s_in_fragment(left + 1.f);
-    const float down = wrap_t_in_fragment(up + 1.f);
+    const float left = wrap_s_texel_in_fragment(s_int);
+    const float up = wrap_t_texel_in_fragment(t_int);
+    const float right = wrap_s_texel_in_fragment(left + 1.f);
+    const float down = wrap_t_texel_in_fragment(up + 1.f);
 
     const std::array<color, 4> texels = {
-        (left  < 0.f || up   < 0.f) ? black : in_sampled_image.pixels[size_t(left + up * in_sampled_image.size.width)],
-        (right < 0.f || up   < 0.f) ? black : in_sampled_image.pixels[size_t(right + up * in_sampled_image.size.width)],
-        (left  < 0.f || down < 0.f) ? black : in_sampled_image.pixels[size_t(left + down * in_sampled_image.size.width)],
-        (right < 0.f || down < 0.f) ? black : in_sampled_image.pixels[size_t(right + down * in_sampled_image.size.width)],
+        (left  < 0.f || up   < 0.f) ? black : in_texels.at(uint32_t(left), uint32_t(up)),
+        (right < 0.f || up   < 0.f) ? black : in_texels.at(uint32_t(right), uint32_t(up)),
+        (left  < 0.f || down < 0.f) ? black : in_texels.at(uint32_t(left), uint32_t(down)),
+        (right < 0.f || down < 0.f) ? black : in_texels.at(uint32_t(right), uint32_t(down)),
     };
 
     return std::make_tuple(texels, s_fract, t_fract);
 }
 
-glm::vec3 filter_catrom(const vector_map& in_sampled_image, const min_max<texture_position_2D>& in_image_fragment,
-    const barycentric_2D& in_mapping, const wrap_method in_wrap_method)
+template <wrap_mode W, typename T>
+static glm::vec3 filter_catrom(const T& in_texels,
+    const min_max<texture_position_2D>& in_image_fragment, const barycentric_2D& in_mapping)
 {
-    const auto [neighbors, U, V] = pick_4x4_neighbors_and_interpolants(
-        in_sampled_image, in_image_fragment, in_mapping, in_wrap_method);
+    const auto [neighbors, U, V] = pick_4x4_neighbors_and_interpolants<W>(
+        in_texels, in_image_fragment, in_mapping);
     return bicatrom(neighbors, U, V);
 }
 
-glm::vec3 filter_linear(const vector_map& in_sampled_image, const min_max<texture_position_2D>& in_image_fragment,
-    const barycentric_2D& in_mapping, const wrap_method in_wrap_method)
+template <wrap_mode W, typename T>
+static glm::vec3 filter_linear(const T& in_texels,
+    const min_max<texture_position_2D>& in_image_fragment, const barycentric_2D& in_mapping)
 {
-    const auto [neighbors, U, V] = pick_2x2_neighbors_and_interpolants(
-        in_sampled_image, in_image_fragment, in_mapping, in_wrap_method);
+    const auto [neighbors, U, V] = pick_2x2_neighbors_and_interpolants<W>(
+        in_texels, in_image_fragment, in_mapping);
     return bilerp(neighbors, U, V);
 }
 
-glm::vec3 filter_nearest(const vector_map& in_sampled_image, const min_max<texture_position_2D>& in_image_fragment,
-    const barycentric_2D& in_mapping, const wrap_method in_wrap_method)
+#else
+
+// SSE kernels, computing the same wrapping and weights as the scalar path four lanes at a time. Texels
+// are still read one by one, since the renderer samples a single hit at a time.
+
+static __m128 floor_4(const __m128 in_values)
+{
+    const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(in_values));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, in_values), _mm_set1_ps(1.f)));
+}
+
+static __m128 mod_4(const __m128 in_values, const __m128 in_divisors)
+{
+    return _mm_sub_ps(in_values, _mm_mul_ps(in_divisors, floor_4(_mm_div_ps(in_values, in_divisors))));
+}
+
+template <wrap_mode W>
+static __m128 wrap_4(const __m128 in_values, const __m128 in_min, const __m128 in_max)
+{
+    const __m128 last = _mm_sub_ps(in_max, _mm_set1_ps(1.f));
+    if constexpr (W == wrap_mode::clamp_to_border)
+    {
+        const __m128 inside = _mm_and_ps(_mm_cmpge_ps(in_values, in_min), _mm_cmple_ps(in_values, last));
+        return _mm_or_ps(_mm_and_ps(inside, in_values), _mm_andnot_ps(inside, _mm_set1_ps(-1.f)));
+    }
+    else if constexpr (W == wrap_mode::clamp_to_edge)
+    {
+        return _mm_min_ps(_mm_max_ps(in_values, in_min), last);
+    }
+    else if constexpr (W == wrap_mode::mirrored_repeat)
+    {
+        const __m128 range_size = _mm_sub_ps(last, in_min);
+        const __m128 absolute = _mm_andnot_ps(_mm_set1_ps(-0.f), in_values);
+        const __m128 normalized = _mm_div_ps(_mm_sub_ps(absolute, in_min), range_size);
+        const __m128 whole = floor_4(normalized);
+        const __m128 fract = _mm_sub_ps(normalized, whole);
+        const __m128 is_odd = _mm_cmpneq_ps(mod_4(whole, _mm_set1_ps(2.f)), _mm_setzero_ps());
+        const __m128 mirrored = _mm_or_ps(
+            _mm_and_ps(is_odd, _mm_sub_ps(_mm_set1_ps(1.f), fract)), _mm_andnot_ps(is_odd, fract));
+        return _mm_add_ps(in_min, _mm_mul_ps(mirrored, range_size));
+    }
+    else
+    {
+        return _mm_add_ps(in_min, mod_4(_mm_sub_ps(in_values, in_min), _mm_sub_ps(in_max, in_min)));
+    }
+}
+
+template <wrap_mode W>
+static __m128 wrap_texel_4(const __m128 in_values, const __m128 in_min, const __m128 in_max)
+{
+    if constexpr (W == wrap_mode::repeat_power_of_two)
+    {
+        const __m128i min = _mm_cvttps_epi32(in_min);
+        const __m128i mask = _mm_sub_epi32(_mm_sub_epi32(_mm_cvttps_epi32(in_max), min), _mm_set1_epi32(1));
+        const __m128i offsets = _mm_and_si128(_mm_sub_epi32(_mm_cvttps_epi32(in_values), min), mask);
+        return _mm_cvtepi32_ps(_mm_add_epi32(min, offsets));
+    }
+    else
+    {
+        return wrap_4<W>(in_values, in_min, in_max);
+    }
+}
+
+// Catmull-Rom weights of the four neighbors as the product of the spline basis matrix with (t^3, t^2, t, 1).
+static __m128 catrom_weights_4(const float in_t)
+{
+    const float t2 = in_t * in_t;
+    const float t3 = t2 * in_t;
+    const __m128 weights = _mm_add_ps(
+        _mm_add_ps(
+            _mm_mul_ps(_mm_setr_ps(-1.f, 3.f, -3.f, 1.f), _mm_set1_ps(t3)),
+            _mm_mul_ps(_mm_setr_ps(2.f, -5.f, 4.f, -1.f), _mm_set1_ps(t2))),
+        _mm_add_ps(
+            _mm_mul_ps(_mm_setr_ps(-1.f, 0.f, 1.f, 0.f), _mm_set1_ps(in_t)),
+            _mm_setr_ps(0.f, 2.f, 0.f, 0.f)));
+    return _mm_mul_ps(weights, _mm_set1_ps(0.5f));
+}
+
+template <typename T>
+static __m128 texel_4(const T& in_texels, const float in_s, const float in_t)
 {
-    if (const barycentric_2D final_mapping = wrap(in_mapping, in_wrap_method);
+    const glm::vec3 value = in_texels.at(uint32_t(in_s), uint32_t(in_t));
+    return _mm_setr_ps(value.x, value.y, value.z, 0.f);
+}
+
+static glm::vec3 to_vec3(const __m128 in_value)
+{
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, in_value);
+    return glm::vec3{ lanes[0], lanes[1], lanes[2] };
+}
+
+// The wrapped texture coordinate of a mapping split into integer and fractional parts, in lanes (s, t, -, -).
+struct texcoord_4
+{
+    __m128 whole;
+    __m128 fract;
+};
+
+template <wrap_mode W>
+static texcoord_4 wrapped_texcoord_4(const barycentric_2D& in_mapping, const __m128 in_min, const __m128 in_max)
+{
+    const __m128 fragment_size = _mm_sub_ps(in_max, in_min);
+    const __m128 texcoord = wrap_4<W>(
+        _mm_add_ps(_mm_sub_ps(in_min, _mm_set1_ps(0.5f)), _mm_mul_ps(_mm_setr_ps(in_mapping.U, in_mapping.V, 0.f, 0.f), fragment_size)),
+        in_min, in_max);
+    const __m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(texcoord));
+    return texcoord_4{ whole, _mm_sub_ps(texcoord, whole) };
+}
+
+template <wrap_mode W, typename T>
+static glm::vec3 filter_catrom(const T& in_texels,
+    const min_max<texture_position_2D>& in_image_fragment, const barycentric_2D& in_mapping)
+{
+    const __m128 min = _mm_setr_ps(in_image_fragment.min.s, in_image_fragment.min.t, 0.f, 0.f);
+    const __m128 max = _mm_setr_ps(in_image_fragment.max.s, in_image_fragment.max.t, 1.f, 1.f);
+    const auto [whole, fract] = wrapped_texcoord_4<W>(in_mapping, min, max);
+
+    alignas(16) float texcoord_whole[4], texcoord_fract[4];
+    _mm_store_ps(texcoord_whole, whole);
+    _mm_store_ps(texcoord_fract, fract);
+
+    const __m128 offsets = _mm_setr_ps(-1.f, 0.f, 1.f, 2.f);
+    alignas(16) float s_neighbors[4], t_neighbors[4], s_weights[4], t_weights[4];
+    _mm_store_ps(s_neighbors, wrap_texel_4<W>(_mm_add_ps(_mm_set1_ps(texcoord_whole[0]), offsets),
+        _mm_set1_ps(in_image_fragment.min.s), _mm_set1_ps(in_image_fragment.max.s)));
+    _mm_store_ps(t_neighbors, wrap_texel_4<W>(_mm_add_ps(_mm_set1_ps(texcoord_whole[1]), offsets),
+        _mm_set1_ps(in_image_fragment.min.t), _mm_set1_ps(in_image_fragment.max.t)));
+    _mm_store_ps(s_weights, catrom_weights_4(texcoord_fract[0]));
+    _mm_store_ps(t_weights, catrom_weights_4(texcoord_fract[1]));
+
+    // Texels outside of a border are black, so they are left out of the sums.
+    __m128 result = _mm_setzero_ps();
+    for (size_t t = 0; t < 4; ++t)
+    {
+        if (W == wrap_mode::clamp_to_border && t_neighbors[t] < 0.f)
+        {
+            continue;
+        }
+        __m128 row = _mm_setzero_ps();
+        for (size_t s = 0; s < 4; ++s)
+        {
+            if (W != wrap_mode::clamp_to_border || s_neighbors[s] >= 0.f)
+            {
+                const __m128 texel = texel_4(in_texels, s_neighbors[s], t_neighbors[t]);
+                row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(s_weights[s]), texel));
+            }
+        }
+        result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(t_weights[t]), row));
+    }
+    return to_vec3(result);
+}
+
+template <wrap_mode W, typename T>
+static glm::vec3 filter_linear(const T& in_texels,
+    const min_max<texture_position_2D>& in_image_fragment, const barycentric_2D& in_mapping)
+{
+    const __m128 min = _mm_setr_ps(in_image_fragment.min.s, in_image_fragment.min.t, 0.f, 0.f);
+    const __m128 max = _mm_setr_ps(in_image_fragment.max.s, in_image_fragment.max.t, 1.f, 1.f);
+    const auto [whole, fract] = wrapped_texcoord_4<W>(in_mapping, min, max);
+
+    // Lanes (left, up, -, -), then (right, down, -, -) wrapped from them.
+    alignas(16) float first[4], second[4], weights[4];
+    const __m128 first_4 = wrap_texel_4<W>(whole, min, max);
+    _mm_store_ps(first, first_4);
+    _mm_store_ps(second, wrap_texel_4<W>(_mm_add_ps(first_4, _mm_set1_ps(1.f)), min, max));
+    _mm_store_ps(weights, fract);
+
+    const auto corner = [&](const float s, const float t) {
+        if (W == wrap_mode::clamp_to_border && (s < 0.f || t < 0.f))
+        {
+            return _mm_setzero_ps();
+        }
+        return texel_4(in_texels, s, t);
+    };
+    const __m128 s_weight = _mm_set1_ps(weights[0]);
+    const __m128 s_weight_complement = _mm_set1_ps(1.f - weights[0]);
+    const __m128 top = _mm_add_ps(
+        _mm_mul_ps(corner(first[0], first[1]), s_weight_complement), _mm_mul_ps(corner(second[0], first[1]), s_weight));
+    const __m128 bottom = _mm_add_ps(
+        _mm_mul_ps(corner(first[0], second[1]), s_weight_complement), _mm_mul_ps(corner(second[0], second[1]), s_weight));
+    return to_vec3(_mm_add_ps(
+        _mm_mul_ps(top, _mm_set1_ps(1.f - weights[1])), _mm_mul_ps(bottom, _mm_set1_ps(weights[1]))));
+}
+
+#endif
+
+template <wrap_mode W, typename T>
+static glm::vec3 filter_nearest(const T& in_texels,
+    const min_max<texture_position_2D>& in_image_fragment, const barycentric_2D& in_mapping)
+{
+    if (const barycentric_2D final_mapping = wrap_unit<W>(in_mapping);
         final_mapping.U >= 0.f && final_mapping.V >= 0.f)
     {
         const uint32_t width = in_image_fragment.max.s - in_image_fragment.min.s;
@@ -146,7 +556,207 @@ glm::vec3 filter_nearest(const vector_map& in_sampled_image, const min_max<textu
             in_image_fragment.min.s + final_mapping.U * width,
             in_image_fragment.min.t + final_mapping.V * height,
         };
-        return in_sampled_image.pixels[nearest.x + (nearest.y * in_sampled_image.size.width)];
+        return in_texels.at(nearest.x, nearest.y);
     }
     return black;
-}
\ No newline at end of file
+}
+
+// Stochastic filtering
+
+// Picks an index with the probability of its absolute weight. Catmull-Rom weights can be negative, so
+// the pick comes with the factor keeping the expected value equal to the weighted sum.
+template <size_t N>
+static std::pair<size_t, float> pick_by_weight(const std::array<float, N>& in_weights)
+{
+    float total = 0.f;
+    for (const float weight : in_weights)
+    {
+        total += glm::abs(weight);
+    }
+
+    size_t picked = 0;
+    float threshold = random_uniform(0.f, total);
+    for (size_t i = 0; i < N; ++i)
+    {
+        if (in_weights[i] != 0.f)
+        {
+            picked = i;
+            threshold -= glm::abs(in_weights[i]);
+            if (threshold < 0.f)
+            {
+                break;
+            }
+        }
+    }
+    return { picked, in_weights[picked] < 0.f ? -total : total };
+}
+
+static std::array<float, 4> catrom_weights(const float in_t)
+{
+    const float t2 = in_t * in_t;
+    const float t3 = t2 * in_t;
+    return {
+        0.5f * (-t3 + (2.f * t2) - in_t),
+        0.5f * ((3.f * t3) - (5.f * t2) + 2.f),
+        0.5f * ((-3.f * t3) + (4.f * t2) + in_t),
+        0.5f * (t3 - t2),
+    };
+}
+
+// N is the footprint of the filter along each axis, 4 for Catmull-Rom and 2 for linear.
+template <wrap_mode W, size_t N, typename T>
+static glm::vec3 filter_stochastic(const T& in_texels,
+    const min_max<texture_position_2D>& in_image_fragment, const barycentric_2D& in_mapping)
+{
+    const min_max<float> s_fragment = { in_image_fragment.min.s, in_image_fragment.max.s };
+    const min_max<float> t_fragment = { in_image_fragment.min.t, in_image_fragment.max.t };
+
+    const texture_position_2D texcoord = {
+        wrap<W>(s_fragment.min - 0.5f + (in_mapping.U * (s_fragment.max - s_fragment.min)), s_fragment),
+        wrap<W>(t_fragment.min - 0.5f + (in_mapping.V * (t_fragment.max - t_fragment.min)), t_fragment),
+    };
+
+    float s_int, t_int;
+    const float s_fract = glm::modf(texcoord.s, s_int);
+    const float t_fract = glm::modf(texcoord.t, t_int);
+
+    std::pair<size_t, float> s_pick, t_pick;
+    float first_offset;
+    if constexpr (N == 4)
+    {
+        s_pick = pick_by_weight(catrom_weights(s_fract));
+        t_pick = pick_by_weight(catrom_weights(t_fract));
+        first_offset = -1.f;
+    }
+    else
+    {
+        s_pick = pick_by_weight(std::array<float, 2>{ 1.f - s_fract, s_fract });
+        t_pick = pick_by_weight(std::array<float, 2>{ 1.f - t_fract, t_fract });
+        first_offset = 0.f;
+    }
+
+    const float s = wrap_texel<W>(s_int + first_offset + float(s_pick.first), s_fragment);
+    const float t = wrap_texel<W>(t_int + first_offset + float(t_pick.first), t_fragment);
+    if (s < 0.f || t < 0.f)
+    {
+        return black;
+    }
+    return in_texels.at(uint32_t(s), uint32_t(t)) * (s_pick.second * t_pick.second);
+}
+
+// Samplers
+
+// Reads the texels of one level without branching on the format or layout.
+template <texel_format TF, texel_layout TL>
+struct level_texels
+{
+    const vector_map& map;
+    const mip_level& level;
+
+    glm::vec3 at(const uint32_t in_x, const uint32_t in_y) const
+    {
+        return this->map.template texel_in<TF, TL>(this->level, in_x, in_y);
+    }
+};
+
+template <texel_format TF, texel_layout TL, filtering_method F, wrap_mode W>
+static glm::vec3 sample(const vector_map& in_sampled_image, const uint32_t in_level,
+    const min_max<texture_position_2D>& in_image_fragment, const barycentric_2D& in_mapping)
+{
+    const level_texels<TF, TL> texels{ in_sampled_image, in_sampled_image.levels[in_level] };
+    const min_max<texture_position_2D> image_fragment = fragment_at_level(in_sampled_image, in_image_fragment, in_level);
+    if constexpr (F == filtering_method::catrom)
+    {
+        return filter_catrom<W>(texels, image_fragment, in_mapping);
+    }
+    else if constexpr (F == filtering_method::linear)
+    {
+        return filter_linear<W>(texels, image_fragment, in_mapping);
+    }
+    else if constexpr (F == filtering_method::nearest)
+    {
+        return filter_nearest<W>(texels, image_fragment, in_mapping);
+    }
+    else if constexpr (F == filtering_method::stochastic_catrom)
+    {
+        return filter_stochastic<W, 4>(texels, image_fragment, in_mapping);
+    }
+    else
+    {
+        return filter_stochastic<W, 2>(texels, image_fragment, in_mapping);
+    }
+}
+
+template <texel_format TF, texel_layout TL, filtering_method F>
+static constexpr std::array<sampler_function, wrap_mode_count> samplers_filtering_with = {
+    sample<TF, TL, F, wrap_mode::clamp_to_border>,
+    sample<TF, TL, F, wrap_mode::clamp_to_edge>,
+    sample<TF, TL, F, wrap_mode::mirrored_repeat>,
+    sample<TF, TL, F, wrap_mode::repeat>,
+    sample<TF, TL, F, wrap_mode::repeat_power_of_two>,
+};
+
+static constexpr size_t filtering_method_count = 5;
+
+template <texel_format TF, texel_layout TL>
+static constexpr std::array<const std::array<sampler_function, wrap_mode_count>*, filtering_method_count> samplers_reading = {
+    &samplers_filtering_with<TF, TL, filtering_method::catrom>,
+    &samplers_filtering_with<TF, TL, filtering_method::linear>,
+    &samplers_filtering_with<TF, TL, filtering_method::nearest>,
+    &samplers_filtering_with<TF, TL, filtering_method::stochastic_catrom>,
+    &samplers_filtering_with<TF, TL, filtering_method::stochastic_linear>,
+};
+
+// Indexed by texel format, then by texel layout.
+static constexpr std::array<std::array<const std::array<const std::array<sampler_function, wrap_mode_count>*, filtering_method_count>*, 2>, 4> samplers = { {
+    { &samplers_reading<texel_format::rgb8, texel_layout::linear>, &samplers_reading<texel_format::rgb8, texel_layout::tiled_4x4> },
+    { &samplers_reading<texel_format::normal_oct16, texel_layout::linear>, &samplers_reading<texel_format::normal_oct16, texel_layout::tiled_4x4> },
+    { &samplers_reading<texel_format::rgb16f, texel_layout::linear>, &samplers_reading<texel_format::rgb16f, texel_layout::tiled_4x4> },
+    { &samplers_reading<texel_format::rgb32f, texel_layout::linear>, &samplers_reading<texel_format::rgb32f, texel_layout::tiled_4x4> },
+} };
+
+static bool is_power_of_two_range(const float in_min, const float in_max)
+{
+    const uint32_t size = uint32_t(in_max - in_min);
+    return in_min >= 0.f && float(uint32_t(in_min)) == in_min && float(uint32_t(in_max)) == in_max
+        && size > 0 && (size & (size - 1)) == 0 && uint32_t(in_min) % size == 0;
+}
+
+// Masking only wraps right while the fragment stays a power of two aligned to its size on every level
+// it can be sampled from. Levels of maps whose size is not a power of two shrink by uneven factors.
+static bool is_power_of_two_fragment(const min_max<texture_position_2D>& in_fragment, const extent_2D<uint32_t>& in_map_size)
+{
+    extent_2D<uint32_t> level_size = in_map_size;
+    for (uint32_t level = 0; level <= last_level_of_fragment(in_fragment); ++level)
+    {
+        const min_max<texture_position_2D> fragment = scale_fragment(in_fragment, in_map_size, level_size);
+        if (!is_power_of_two_range(fragment.min.s, fragment.max.s) || !is_power_of_two_range(fragment.min.t, fragment.max.t))
+        {
+            return false;
+        }
+        level_size = { std::max(1u, level_size.width / 2), std::max(1u, level_size.height / 2) };
+    }
+    return true;
+}
+
+uint32_t sampler_index(const filtering_method in_filtering_method, const wrap_method in_wrap_method,
+    const min_max<texture_position_2D>& in_map_fragment, const extent_2D<uint32_t>& in_map_size)
+{
+    wrap_mode mode = wrap_mode::clamp_to_border;
+    switch (in_wrap_method)
+    {
+        case wrap_method::clamp_to_border: mode = wrap_mode::clamp_to_border; break;
+        case wrap_method::clamp_to_edge:   mode = wrap_mode::clamp_to_edge; break;
+        case wrap_method::mirrored_repeat: mode = wrap_mode::mirrored_repeat; break;
+        case wrap_method::repeat:
+            mode = is_power_of_two_fragment(in_map_fragment, in_map_size) ? wrap_mode::repeat_power_of_two : wrap_mode::repeat;
+            break;
+    }
+    return (uint32_t(in_filtering_method) * wrap_mode_count) + uint32_t(mode);
+}
+
+sampler_function sampler_at(const uint32_t in_sampler_index, const vector_map& in_map)
+{
+    const auto& samplers_of_map = *samplers[size_t(in_map.format)][size_t(in_map.layout)];
+    return (*samplers_of_map[in_sampler_index / wrap_mode_count])[in_sampler_index % wrap_mode_count];
+}
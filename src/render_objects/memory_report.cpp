@@ -0,0 +1,181 @@
+#include <render_objects/memory_report.hpp>
+
+#include <render_objects/scene.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+
+void memory_usage::add(const memory_usage& in_usage)
+{
+    this->count += in_usage.count;
+    this->owned_bytes += in_usage.owned_bytes;
+    this->capacity_bytes += in_usage.capacity_bytes;
+    this->mapped_bytes += in_usage.mapped_bytes;
+    this->paged_bytes += in_usage.paged_bytes;
+}
+
+memory_usage memory_report::total() const
+{
+    memory_usage total{ "total" };
+    for (const memory_usage& it_part : this->parts)
+    {
+        total.add(it_part);
+    }
+    total.owned_bytes += this->texture_page_bytes;
+    total.capacity_bytes += this->texture_page_budget - std::min(this->texture_page_budget, this->texture_page_bytes);
+    return total;
+}
+
+static std::string mebibytes(const size_t in_bytes)
+{
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(2) << double(in_bytes) / double(1 << 20);
+    return text.str();
+}
+
+void memory_report::print(std::ostream& out_stream) const
+{
+    const auto print_row = [&](const std::string& name, const std::string& count, const std::string& owned,
+        const std::string& capacity, const std::string& mapped, const std::string& paged)
+    {
+        out_stream << std::left << std::setw(24) << name << std::right << std::setw(12) << count
+            << std::setw(12) << owned << std::setw(12) << capacity << std::setw(12) << mapped
+            << std::setw(12) << paged << '\n';
+    };
+    const auto print_usage = [&](const memory_usage& usage)
+    {
+        print_row(usage.name, std::to_string(usage.count), mebibytes(usage.owned_bytes),
+            mebibytes(usage.capacity_bytes), mebibytes(usage.mapped_bytes), mebibytes(usage.paged_bytes));
+    };
+
+    print_row("MiB", "count", "owned", "capacity", "mapped", "paged");
+    for (const memory_usage& it_part : this->parts)
+    {
+        print_usage(it_part);
+    }
+    if (this->texture_page_budget > 0)
+    {
+        print_row("texture pages", "", mebibytes(this->texture_page_bytes), mebibytes(this->texture_page_budget), "", "");
+    }
+    print_usage(this->total());
+    out_stream << std::flush;
+}
+
+std::string memory_report::to_json() const
+{
+    std::ostringstream json;
+    const auto write_usage = [&](const memory_usage& usage)
+    {
+        json << "{ \"name\": \"" << usage.name << "\", \"count\": " << usage.count
+            << ", \"owned_bytes\": " << usage.owned_bytes << ", \"capacity_bytes\": " << usage.capacity_bytes
+            << ", \"mapped_bytes\": " << usage.mapped_bytes << ", \"paged_bytes\": " << usage.paged_bytes << " }";
+    };
+
+    json << "{\n  \"parts\": [\n";
+    for (size_t i = 0; i < this->parts.size(); ++i)
+    {
+        json << "    ";
+        write_usage(this->parts[i]);
+        json << (i + 1 < this->parts.size() ? ",\n" : "\n");
+    }
+    json << "  ],\n  \"texture_page_bytes\": " << this->texture_page_bytes
+        << ",\n  \"texture_page_budget\": " << this->texture_page_budget << ",\n  \"total\": ";
+    write_usage(this->total());
+    json << "\n}\n";
+    return json.str();
+}
+
+// Report
+
+template <typename T, typename Allocator>
+static memory_usage usage_of(const std::string& in_name, const mapped_array<T, Allocator>& in_array)
+{
+    memory_usage usage{ in_name, in_array.size() };
+    if (in_array.is_mapped())
+    {
+        usage.mapped_bytes = sizeof(T) * in_array.size();
+    }
+    else
+    {
+        usage.owned_bytes = sizeof(T) * in_array.size();
+        usage.capacity_bytes = sizeof(T) * (in_array.capacity() - in_array.size());
+    }
+    return usage;
+}
+
+static memory_usage usage_of(const std::string& in_name, const std::vector<vector_map>& in_maps)
+{
+    memory_usage usage{ in_name, in_maps.size() };
+    usage.owned_bytes = sizeof(vector_map) * in_maps.size();
+    usage.capacity_bytes = sizeof(vector_map) * (in_maps.capacity() - in_maps.size());
+    for (const vector_map& it_map : in_maps)
+    {
+        usage.owned_bytes += sizeof(mip_level) * it_map.levels.size();
+        usage.capacity_bytes += sizeof(mip_level) * (it_map.levels.capacity() - it_map.levels.size());
+        if (it_map.texels.is_paged())
+        {
+            usage.paged_bytes += it_map.texels.size();
+        }
+        else if (it_map.texels.is_mapped())
+        {
+            usage.mapped_bytes += it_map.texels.size();
+        }
+        else
+        {
+            usage.owned_bytes += it_map.texels.size();
+            usage.capacity_bytes += it_map.texels.capacity() - it_map.texels.size();
+        }
+    }
+    return usage;
+}
+
+memory_report report_memory(const scene& in_scene)
+{
+    memory_report report;
+    report.parts = {
+        usage_of("hierarchy", in_scene.hierarchy),
+        usage_of("hierarchy end clips", in_scene.hierarchy_end_clips),
+        usage_of("infinite shapes", in_scene.infinite_shapes),
+        usage_of("shapes", in_scene.shapes),
+        usage_of("sphere shapes", in_scene.sphere_shapes),
+        usage_of("plane shapes", in_scene.plane_shapes),
+        usage_of("triangle shapes", in_scene.triangle_shapes),
+        usage_of("mesh triangle shapes", in_scene.mesh_triangle_shapes),
+        usage_of("mesh positions", in_scene.mesh_positions),
+        usage_of("mesh normals", in_scene.mesh_normals),
+        usage_of("mesh mappings", in_scene.mesh_mappings),
+        usage_of("quantized triangles", in_scene.quantized_mesh_triangle_shapes),
+        usage_of("quantized vertices", in_scene.quantized_mesh_vertices),
+        usage_of("quantized meshes", in_scene.quantized_meshes),
+        usage_of("quantized mesh hierarchies", in_scene.quantized_mesh_hierarchies),
+        usage_of("moving sphere shapes", in_scene.moving_sphere_shapes),
+        usage_of("mesh end positions", in_scene.mesh_end_positions),
+        usage_of("dielectric materials", in_scene.dielectric_materials),
+        usage_of("diffuse materials", in_scene.diffuse_materials),
+        usage_of("emit light materials", in_scene.emit_light_materials),
+        usage_of("reflect materials", in_scene.reflect_materials),
+        usage_of("checker textures", in_scene.checker_textures),
+        usage_of("constant textures", in_scene.constant_textures),
+        usage_of("image textures", in_scene.image_textures),
+        usage_of("noise textures", in_scene.noise_textures),
+        usage_of("normal textures", in_scene.normal_textures),
+        usage_of("images", in_scene.images),
+        usage_of("normal maps", in_scene.normal_maps),
+    };
+    if (in_scene.lazy_hierarchy)
+    {
+        const lazy_BIH& lazy_hierarchy = *in_scene.lazy_hierarchy;
+        report.parts.push_back(memory_usage{ "lazy hierarchy", lazy_hierarchy.expanded_node_count(),
+            lazy_BIH::node_size * lazy_hierarchy.expanded_node_count(),
+            lazy_BIH::node_size * (lazy_hierarchy.node_capacity() - lazy_hierarchy.expanded_node_count()) });
+    }
+    if (in_scene.texture_pages)
+    {
+        const page_cache::statistics pages = in_scene.texture_pages->stats();
+        report.texture_page_bytes = pages.resident_bytes;
+        report.texture_page_budget = pages.byte_budget;
+    }
+    return report;
+}
\ No newline at end of file
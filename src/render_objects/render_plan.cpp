@@ -3,7 +3,8 @@
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
 
-render_plan render_plan::test_scene(const extent_2D<uint32_t>& image_size)
+render_plan render_plan::test_scene(const extent_2D<uint32_t>& image_size,
+    const std::filesystem::path& texture_cache_directory)
 {
     const camera cam = camera_create_info{
         position_3D{ 0.75f, 0.35f, -1.25f },
@@ -16,6 +17,7 @@ render_plan render_plan::test_scene(const extent_2D<uint32_t>& image_size)
     };
 
     scene world;
+    world.texture_cache_directory = texture_cache_directory;
     world.sky = world.add_image_texture(world.add_image("textures/sky_evening.jpg"),
         wrap_method::repeat, filtering_method::linear);
 
@@ -93,7 +95,8 @@ render_plan render_plan::test_scene(const extent_2D<uint32_t>& image_size)
         world.add_dielectric_material(1.5f,
             world.add_constant_texture(color{ 0.7f, 0.7f, 1.f })));
 
-    world.hierarchy = make_hierarchy(world.shapes);
+    world.resolve_assets();
+    world.build_hierarchy();
     return render_plan{ image_size, cam, std::move(world) };
 }
 
@@ -163,11 +166,13 @@ render_plan render_plan::cornell_box(const extent_2D<uint32_t>& image_size)
         world.add_emit_light_material(15.f, world.add_constant_texture(white)),
     });
 
-    world.hierarchy = make_hierarchy(world.shapes);
+    world.resolve_assets();
+    world.build_hierarchy();
     return render_plan{ image_size, cam, std::move(world) };
 }
 
-render_plan render_plan::grass_block(const extent_2D<uint32_t>& image_size)
+render_plan render_plan::grass_block(const extent_2D<uint32_t>& image_size,
+    const std::filesystem::path& texture_cache_directory)
 {
     const camera cam = camera_create_info{
         position_3D{ 2.f, 0.75f, -2.5f },
@@ -180,6 +185,7 @@ render_plan render_plan::grass_block(const extent_2D<uint32_t>& image_size)
     };
 
     scene world;
+    world.texture_cache_directory = texture_cache_directory;
     world.sky = world.add_image_texture(world.add_image("textures/sky.jpg"),
         wrap_method::repeat, filtering_method::linear);
 
@@ -208,11 +214,13 @@ render_plan render_plan::grass_block(const extent_2D<uint32_t>& image_size)
         bottom_face, top_face, side_face, side_face, side_face, side_face,
     });
 
-    world.hierarchy = make_hierarchy(world.shapes);
+    world.resolve_assets();
+    world.build_hierarchy();
     return render_plan{ image_size, cam, std::move(world) };
 }
 
-render_plan render_plan::bunny(const extent_2D<uint32_t>& image_size)
+render_plan render_plan::bunny(const extent_2D<uint32_t>& image_size,
+    const std::filesystem::path& texture_cache_directory)
 {
     const camera cam = camera_create_info{
         position_3D{ 2.5f, 2.f, 2.5f },
@@ -225,6 +233,7 @@ render_plan render_plan::bunny(const extent_2D<uint32_t>& image_size)
     };
 
     scene world;
+    world.texture_cache_directory = texture_cache_directory;
     world.sky = world.add_image_texture(world.add_image("textures/sky.jpg"),
         wrap_method::repeat, filtering_method::linear);
 
@@ -237,8 +246,51 @@ render_plan render_plan::bunny(const extent_2D<uint32_t>& image_size)
         bunny_info.mat = world.add_dielectric_material(1.77f, world.add_constant_texture(color{ 15.f, 82.f, 186.f } / 255.f));
 //        bunny_info.mat = world.add_reflect_material(0.05f, world.add_constant_texture(white));
         world.assemble_model(bunny_info);
+//        world.assemble_model(bunny_info, mesh_encoding::quantized);
     }
 
-    world.hierarchy = make_hierarchy(world.shapes);
+    world.resolve_assets();
+    world.build_hierarchy();
     return render_plan{ image_size, cam, std::move(world) };
+}
+
+render_plan render_plan::grass_block_turntable(const extent_2D<uint32_t>& image_size,
+    const std::filesystem::path& texture_cache_directory)
+{
+    render_plan plan = grass_block(image_size, texture_cache_directory);
+
+    const array_index ball = plan.world.moving_sphere_shapes.size();
+    plan.world.add_moving_sphere_shape(
+        moving_sphere_shape{ sphere_shape{ sphere{ position_3D{ 0.f, 0.75f, 0.f }, 0.25f }, y_axis }, position_3D{ 0.f, 0.75f, 0.f } },
+        plan.world.add_reflect_material(0.02f, plan.world.add_constant_texture(color{ 0.9f, 0.9f, 0.9f })));
+    plan.world.build_hierarchy();
+
+    constexpr uint32_t frame_count = 48;
+    plan.anim.frame_count = frame_count;
+    plan.anim.animate_camera = [aspect_ratio = image_size.aspect()](const animation_frame& frame)
+    {
+        const float angle = glm::two_pi<float>() * float(frame.index) / float(frame_count);
+        return camera_create_info{
+            position_3D{ 3.2f * glm::sin(angle), 0.75f, -3.2f * glm::cos(angle) },
+            position_3D{ 0.f, 0.f, 0.f },
+            y_axis,
+            45.f,
+            aspect_ratio,
+            0.05f,
+            frame.time,
+        };
+    };
+    plan.anim.animate_scene = [ball](scene& world, const animation_frame& frame)
+    {
+        // The ball moves while the shutter is open, so it is blurred along its bounce.
+        const auto ball_at = [](const float time)
+        {
+            return position_3D{ 0.f, 0.75f + glm::abs(glm::sin(glm::two_pi<float>() * time)), 0.f };
+        };
+        world.motion_time = frame.time;
+        world.update_moving_sphere_shape(ball, moving_sphere_shape{
+            sphere_shape{ sphere{ ball_at(frame.time.min), 0.25f }, y_axis }, ball_at(frame.time.max) });
+        return scene_changes::geometry;
+    };
+    return plan;
 }
\ No newline at end of file
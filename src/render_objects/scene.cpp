@@ -1,19 +1,44 @@
 #include <render_objects/scene.hpp>
 
+#include <render_objects/memory_report.hpp>
+#include <render_objects/texture_cache.hpp>
+#include <util/parallel.hpp>
+
 #include <external/stb_image.h>
 
 #include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+static uint32_t build_thread_count()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
 
 std::vector<uint8_t> scene::to_bytes() const
 {
     const size_t sky_size = sizeof(texture);
     const size_t hierarchy_size = sizeof(BIH_node) * this->hierarchy.size();
+    const size_t hierarchy_end_clips_size = sizeof(BIH_clip) * this->hierarchy_end_clips.size();
 
     const size_t infinite_shapes_size = sizeof(shape) * this->infinite_shapes.size();
     const size_t shapes_size = sizeof(shape) * this->shapes.size();
     const size_t sphere_shapes_size = sizeof(sphere_shape) * this->sphere_shapes.size();
     const size_t plane_shapes_size = sizeof(plane_shape) * this->plane_shapes.size();
     const size_t triangle_shapes_size = sizeof(triangle_shape) * this->triangle_shapes.size();
+    const size_t mesh_triangle_shapes_size = sizeof(mesh_triangle_shape) * this->mesh_triangle_shapes.size();
+    const size_t mesh_positions_size = sizeof(position_3D) * this->mesh_positions.size();
+    const size_t mesh_normals_size = sizeof(direction_3D) * this->mesh_normals.size();
+    const size_t mesh_mappings_size = sizeof(barycentric_2D) * this->mesh_mappings.size();
+    const size_t quantized_mesh_triangle_shapes_size = sizeof(quantized_mesh_triangle_shape) * this->quantized_mesh_triangle_shapes.size();
+    const size_t quantized_mesh_vertices_size = sizeof(quantized_vertex) * this->quantized_mesh_vertices.size();
+    const size_t quantized_meshes_size = sizeof(quantized_mesh) * this->quantized_meshes.size();
+    const size_t quantized_mesh_hierarchies_size = sizeof(BIH_node) * this->quantized_mesh_hierarchies.size();
+    const size_t motion_time_size = sizeof(min_max<float>);
+    const size_t moving_sphere_shapes_size = sizeof(moving_sphere_shape) * this->moving_sphere_shapes.size();
+    const size_t mesh_end_positions_size = sizeof(position_3D) * this->mesh_end_positions.size();
 
     const size_t dielectric_materials_size = sizeof(dielectric_material) * this->dielectric_materials.size();
     const size_t diffuse_materials_size = sizeof(diffuse_material) * this->diffuse_materials.size();
@@ -28,11 +53,23 @@ std::vector<uint8_t> scene::to_bytes() const
 
     std::vector<uint8_t> bytes(sky_size
         + hierarchy_size
+        + hierarchy_end_clips_size
         + infinite_shapes_size
         + shapes_size
         + sphere_shapes_size
         + plane_shapes_size
         + triangle_shapes_size
+        + mesh_triangle_shapes_size
+        + mesh_positions_size
+        + mesh_normals_size
+        + mesh_mappings_size
+        + quantized_mesh_triangle_shapes_size
+        + quantized_mesh_vertices_size
+        + quantized_meshes_size
+        + quantized_mesh_hierarchies_size
+        + motion_time_size
+        + moving_sphere_shapes_size
+        + mesh_end_positions_size
         + dielectric_materials_size
         + diffuse_materials_size
         + emit_light_materials_size
@@ -51,11 +88,23 @@ std::vector<uint8_t> scene::to_bytes() const
     };
     append_data(&this->sky, sky_size);
     append_data(this->hierarchy.data(), hierarchy_size);
+    append_data(this->hierarchy_end_clips.data(), hierarchy_end_clips_size);
     append_data(this->infinite_shapes.data(), infinite_shapes_size);
     append_data(this->shapes.data(), shapes_size);
     append_data(this->sphere_shapes.data(), sphere_shapes_size);
     append_data(this->plane_shapes.data(), plane_shapes_size);
     append_data(this->triangle_shapes.data(), triangle_shapes_size);
+    append_data(this->mesh_triangle_shapes.data(), mesh_triangle_shapes_size);
+    append_data(this->mesh_positions.data(), mesh_positions_size);
+    append_data(this->mesh_normals.data(), mesh_normals_size);
+    append_data(this->mesh_mappings.data(), mesh_mappings_size);
+    append_data(this->quantized_mesh_triangle_shapes.data(), quantized_mesh_triangle_shapes_size);
+    append_data(this->quantized_mesh_vertices.data(), quantized_mesh_vertices_size);
+    append_data(this->quantized_meshes.data(), quantized_meshes_size);
+    append_data(this->quantized_mesh_hierarchies.data(), quantized_mesh_hierarchies_size);
+    append_data(&this->motion_time, motion_time_size);
+    append_data(this->moving_sphere_shapes.data(), moving_sphere_shapes_size);
+    append_data(this->mesh_end_positions.data(), mesh_end_positions_size);
     append_data(this->dielectric_materials.data(), dielectric_materials_size);
     append_data(this->diffuse_materials.data(), diffuse_materials_size);
     append_data(this->emit_light_materials.data(), emit_light_materials_size);
@@ -71,42 +120,8 @@ std::vector<uint8_t> scene::to_bytes() const
 
 size_t scene::size() const
 {
-    const size_t sky_size = sizeof(texture);
-    const size_t hierarchy_size = sizeof(BIH_node) * this->hierarchy.size();
-
-    const size_t infinite_shapes_size = sizeof(shape) * this->infinite_shapes.size();
-    const size_t shapes_size = sizeof(shape) * this->shapes.size();
-    const size_t sphere_shapes_size = sizeof(sphere_shape) * this->sphere_shapes.size();
-    const size_t plane_shapes_size = sizeof(plane_shape) * this->plane_shapes.size();
-    const size_t triangle_shapes_size = sizeof(triangle_shape) * this->triangle_shapes.size();
-
-    const size_t dielectric_materials_size = sizeof(dielectric_material) * this->dielectric_materials.size();
-    const size_t diffuse_materials_size = sizeof(diffuse_material) * this->diffuse_materials.size();
-    const size_t emit_light_materials_size = sizeof(emit_light_material) * this->emit_light_materials.size();
-    const size_t reflect_materials_size = sizeof(reflect_material) * this->reflect_materials.size();
-
-    const size_t checker_textures_size = sizeof(checker_texture) * this->checker_textures.size();
-    const size_t constant_textures_size = sizeof(constant_texture) * this->constant_textures.size();
-    const size_t image_textures_size = sizeof(image_texture) * this->image_textures.size();
-    const size_t noise_textures_size = sizeof(noise_texture) * this->noise_textures.size();
-    const size_t normal_textures_size = sizeof(normal_texture) * this->normal_textures.size();
-
-    return sky_size
-        + hierarchy_size
-        + infinite_shapes_size
-        + shapes_size
-        + sphere_shapes_size
-        + plane_shapes_size
-        + triangle_shapes_size
-        + dielectric_materials_size
-        + emit_light_materials_size
-        + diffuse_materials_size
-        + reflect_materials_size
-        + checker_textures_size
-        + constant_textures_size
-        + image_textures_size
-        + noise_textures_size
-        + normal_textures_size;
+    const memory_usage total = report_memory(*this).total();
+    return total.owned_bytes + total.mapped_bytes + total.paged_bytes;
 }
 
 // Shapes
@@ -135,6 +150,41 @@ shape scene::add_sphere_shape(const sphere& in_sphere, const direction_3D& in_ax
     return this->add_sphere_shape(sphere_shape{ in_sphere, in_axial_tilt }, in_material);
 }
 
+void scene::update_sphere_shape(const array_index in_index, const sphere_shape& in_sphere)
+{
+    this->sphere_shapes[in_index] = in_sphere;
+    for (shape& it_shape : this->shapes)
+    {
+        if (it_shape.type == shape_type::sphere && it_shape.index == in_index)
+        {
+            it_shape.bounding_box = in_sphere.bounding_box();
+            return;
+        }
+    }
+}
+
+shape scene::add_moving_sphere_shape(const moving_sphere_shape& in_sphere, const material& in_material)
+{
+    axis_aligned_box bounding_box = in_sphere.at(0.f).bounding_box();
+    bounding_box.extend(in_sphere.at(1.f).bounding_box());
+    this->shapes.push_back(shape{ shape_type::moving_sphere, this->moving_sphere_shapes.size(), in_material, bounding_box });
+    this->moving_sphere_shapes.push_back(in_sphere);
+    return this->shapes.back();
+}
+
+void scene::update_moving_sphere_shape(const array_index in_index, const moving_sphere_shape& in_sphere)
+{
+    this->moving_sphere_shapes[in_index] = in_sphere;
+    for (shape& it_shape : this->shapes)
+    {
+        if (it_shape.type == shape_type::moving_sphere && it_shape.index == in_index)
+        {
+            it_shape.bounding_box = this->bounding_box_of(it_shape);
+            return;
+        }
+    }
+}
+
 shape scene::add_triangle_shape(const triangle_shape& in_triangle, const material& in_material)
 {
     this->shapes.push_back(shape{ shape_type::triangle, this->triangle_shapes.size(), in_material, in_triangle.bounding_box() });
@@ -158,148 +208,464 @@ shape scene::add_triangle_shape(const triangle& in_triangle, const direction_3D&
         in_mappings[0], in_mappings[1], in_mappings[2] }, in_material);
 }
 
+void scene::update_triangle_shape(const array_index in_index, const triangle_shape& in_triangle)
+{
+    this->triangle_shapes[in_index] = in_triangle;
+}
+
+void scene::transform_mesh_vertices(const size_t in_first_vertex, const size_t in_count, const glm::quat& in_rotation,
+    const displacement_3D& in_translation)
+{
+    position_3D* positions = this->mesh_positions.data() + in_first_vertex;
+    direction_3D* normals = this->mesh_normals.data() + in_first_vertex;
+    position_3D* end_positions = this->mesh_end_positions.data();
+    const size_t end_count = std::min(in_count,
+        this->mesh_end_positions.size() - std::min(this->mesh_end_positions.size(), in_first_vertex));
+    parallel_for(in_count, build_thread_count(), [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
+        {
+            positions[i] = (in_rotation * positions[i]) + in_translation;
+            normals[i] = in_rotation * normals[i];
+            if (i < end_count)
+            {
+                end_positions[in_first_vertex + i] = (in_rotation * end_positions[in_first_vertex + i]) + in_translation;
+            }
+        }
+    });
+}
+
+void scene::set_mesh_vertex_motion(const size_t in_first_vertex, const size_t in_count, const glm::quat& in_end_rotation,
+    const displacement_3D& in_end_translation)
+{
+    // Vertices without an end position yet stay where they are.
+    const size_t first_missing = this->mesh_end_positions.size();
+    this->mesh_end_positions.resize(this->mesh_positions.size());
+    const position_3D* start_positions = this->mesh_positions.data();
+    position_3D* end_positions = this->mesh_end_positions.data();
+    std::copy(start_positions + first_missing, start_positions + this->mesh_positions.size(), end_positions + first_missing);
+    parallel_for(in_count, build_thread_count(), [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first_vertex + in_first; i < in_first_vertex + in_last; ++i)
+        {
+            end_positions[i] = (in_end_rotation * start_positions[i]) + in_end_translation;
+        }
+    });
+
+    const mesh_triangle_shape* triangles = this->mesh_triangle_shapes.data();
+    shape* shapes = this->shapes.data();
+    parallel_for(this->shapes.size(), build_thread_count(), [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
+        {
+            if (shapes[i].type != shape_type::mesh_triangle)
+            {
+                continue;
+            }
+            for (const uint32_t it_index : triangles[shapes[i].index].indices)
+            {
+                if (it_index >= in_first_vertex && it_index < in_first_vertex + in_count)
+                {
+                    shapes[i].type = shape_type::moving_mesh_triangle;
+                    break;
+                }
+            }
+        }
+    });
+}
+
+void scene::remove_shape(const shape_type in_type, const array_index in_index)
+{
+    for (shape& it_shape : this->shapes)
+    {
+        if (it_shape.type == in_type && it_shape.index == in_index)
+        {
+            it_shape.type = shape_type::none;
+            return;
+        }
+    }
+}
+
+axis_aligned_box scene::bounding_box_of(const shape& in_shape) const
+{
+    switch (in_shape.type)
+    {
+        case shape_type::plane:    return this->plane_shapes[in_shape.index].bounding_box();
+        case shape_type::sphere:   return this->sphere_shapes[in_shape.index].bounding_box();
+        case shape_type::triangle: return this->triangle_shapes[in_shape.index].bounding_box();
+        case shape_type::mesh_triangle:
+        {
+            const std::array<uint32_t, 3>& indices = this->mesh_triangle_shapes[in_shape.index].indices;
+            return triangle_shape{ triangle{ this->mesh_positions[indices[0]], this->mesh_positions[indices[1]],
+                this->mesh_positions[indices[2]] } }.bounding_box();
+        }
+        case shape_type::moving_sphere:
+        case shape_type::moving_mesh_triangle:
+        {
+            min_max<axis_aligned_box> boxes = this->motion_bounding_boxes_of(in_shape);
+            boxes.min.extend(boxes.max);
+            return boxes.min;
+        }
+        default: return in_shape.bounding_box;
+    }
+}
+
+min_max<axis_aligned_box> scene::motion_bounding_boxes_of(const shape& in_shape) const
+{
+    switch (in_shape.type)
+    {
+        case shape_type::moving_sphere:
+        {
+            const moving_sphere_shape& it_sphere = this->moving_sphere_shapes[in_shape.index];
+            return { it_sphere.at(0.f).bounding_box(), it_sphere.at(1.f).bounding_box() };
+        }
+        case shape_type::moving_mesh_triangle:
+        {
+            const std::array<uint32_t, 3>& indices = this->mesh_triangle_shapes[in_shape.index].indices;
+            return {
+                triangle_shape{ triangle{ this->mesh_positions[indices[0]], this->mesh_positions[indices[1]],
+                    this->mesh_positions[indices[2]] } }.bounding_box(),
+                triangle_shape{ triangle{ this->mesh_end_positions[indices[0]], this->mesh_end_positions[indices[1]],
+                    this->mesh_end_positions[indices[2]] } }.bounding_box() };
+        }
+        default:
+        {
+            const axis_aligned_box bounding_box = this->bounding_box_of(in_shape);
+            return { bounding_box, bounding_box };
+        }
+    }
+}
+
+void scene::update_bounding_boxes()
+{
+    shape* shapes = this->shapes.data();
+    parallel_for(this->shapes.size(), build_thread_count(), [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
+        {
+            shapes[i].bounding_box = this->bounding_box_of(shapes[i]);
+        }
+    });
+}
+
+bool scene::has_motion() const
+{
+    return !this->moving_sphere_shapes.empty() || !this->mesh_end_positions.empty();
+}
+
+float scene::motion_at(const float in_time) const
+{
+    const float duration = this->motion_time.max - this->motion_time.min;
+    return duration > 0.f ? glm::clamp((in_time - this->motion_time.min) / duration, 0.f, 1.f) : 0.f;
+}
+
 void scene::assemble_quad(const quad_assembly_info& in_info)
 {
-    for (size_t i = 0; i <= 2; i += 2)
-    {
-        const size_t j_0 = i;
-        const size_t j_1 = i + 1;
-        const size_t j_2 = (i + 2) % 4;
-        this->add_triangle_shape(
-            triangle{
-                in_info.vertices[j_0],
-                in_info.vertices[j_1],
-                in_info.vertices[j_2],
-            },
-            std::array<direction_3D, 3>{
-                in_info.normals[j_0],
-                in_info.normals[j_1],
-                in_info.normals[j_2],
-            },
-            std::array<barycentric_2D, 3>{
-                in_info.mappings[j_0],
-                in_info.mappings[j_1],
-                in_info.mappings[j_2],
-            },
-            in_info.mat);
+    for (const triangle_shape& it_triangle : quad_triangles(in_info))
+    {
+        this->add_triangle_shape(it_triangle, in_info.mat);
     }
 }
 
 void scene::assemble_cuboid(const cuboid_assembly_info& in_info)
 {
-    const float width = in_info.half_size.width;
-    const float height = in_info.half_size.height;
-    const float depth = in_info.half_size.depth;
-    const float face_sign = in_info.face_inwards ? -1.f : 1.f;
-
-    const direction_3D normal_d = (-y_axis * in_info.rotation) * face_sign;
-    const direction_3D normal_u = (+y_axis * in_info.rotation) * face_sign;
-    const direction_3D normal_l = (-x_axis * in_info.rotation) * face_sign;
-    const direction_3D normal_r = (+x_axis * in_info.rotation) * face_sign;
-    const direction_3D normal_f = (-z_axis * in_info.rotation) * face_sign;
-    const direction_3D normal_b = (+z_axis * in_info.rotation) * face_sign;
-
-    const displacement_3D vertex_ldf = in_info.rotation * displacement_3D{ -width, -height, -depth };
-    const displacement_3D vertex_ldb = in_info.rotation * displacement_3D{ -width, -height, +depth };
-    const displacement_3D vertex_luf = in_info.rotation * displacement_3D{ -width, +height, -depth };
-    const displacement_3D vertex_lub = in_info.rotation * displacement_3D{ -width, +height, +depth };
-    const displacement_3D vertex_rdf = in_info.rotation * displacement_3D{ +width, -height, -depth };
-    const displacement_3D vertex_rdb = in_info.rotation * displacement_3D{ +width, -height, +depth };
-    const displacement_3D vertex_ruf = in_info.rotation * displacement_3D{ +width, +height, -depth };
-    const displacement_3D vertex_rub = in_info.rotation * displacement_3D{ +width, +height, +depth };
-
-    this->assemble_quad({
+    for (const quad_assembly_info& it_face : cuboid_faces(in_info))
+    {
+        this->assemble_quad(it_face);
+    }
+}
+
+void scene::reserve_shapes(const size_t in_sphere_count, const size_t in_triangle_count)
+{
+    this->shapes.reserve(this->shapes.size() + in_sphere_count + in_triangle_count);
+    this->sphere_shapes.reserve(this->sphere_shapes.size() + in_sphere_count);
+    this->triangle_shapes.reserve(this->triangle_shapes.size() + in_triangle_count);
+}
+
+void scene::add_sphere_shapes(const sphere_shape* in_spheres, const material* in_materials, const size_t in_count)
+{
+    const size_t first_sphere = this->sphere_shapes.size();
+    const size_t first_shape = this->shapes.size();
+    this->sphere_shapes.resize(first_sphere + in_count);
+    this->shapes.resize(first_shape + in_count);
+
+    sphere_shape* spheres = this->sphere_shapes.data() + first_sphere;
+    shape* shapes = this->shapes.data() + first_shape;
+    parallel_for(in_count, build_thread_count(), [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
+        {
+            spheres[i] = in_spheres[i];
+            shapes[i] = shape{ shape_type::sphere, first_sphere + i, in_materials[i], in_spheres[i].bounding_box() };
+        }
+    });
+}
+
+void scene::add_triangle_shapes(const triangle_shape* in_triangles, const material* in_materials, const size_t in_count)
+{
+    const size_t first_triangle = this->triangle_shapes.size();
+    const size_t first_shape = this->shapes.size();
+    this->triangle_shapes.resize(first_triangle + in_count);
+    this->shapes.resize(first_shape + in_count);
+
+    triangle_shape* triangles = this->triangle_shapes.data() + first_triangle;
+    shape* shapes = this->shapes.data() + first_shape;
+    parallel_for(in_count, build_thread_count(), [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
         {
-            in_info.origin + vertex_rdf,
-            in_info.origin + vertex_rdb,
-            in_info.origin + vertex_ldb,
-            in_info.origin + vertex_ldf,
-        },
-        { normal_d, normal_d, normal_d, normal_d },
-        { barycentric_2D{ 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f } },
-        in_info.bottom_face,
+            triangles[i] = in_triangles[i];
+            shapes[i] = shape{ shape_type::triangle, first_triangle + i, in_materials[i], in_triangles[i].bounding_box() };
+        }
     });
-    this->assemble_quad({
+}
+
+void scene::assemble_cuboids(const cuboid_assembly_info* in_infos, const size_t in_count)
+{
+    constexpr size_t triangles_per_cuboid = 12;
+    const size_t first_triangle = this->triangle_shapes.size();
+    const size_t first_shape = this->shapes.size();
+    this->triangle_shapes.resize(first_triangle + (in_count * triangles_per_cuboid));
+    this->shapes.resize(first_shape + (in_count * triangles_per_cuboid));
+
+    triangle_shape* triangles = this->triangle_shapes.data() + first_triangle;
+    shape* shapes = this->shapes.data() + first_shape;
+    parallel_for(in_count, build_thread_count(), [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
+        {
+            size_t j = i * triangles_per_cuboid;
+            for (const quad_assembly_info& it_face : cuboid_faces(in_infos[i]))
+            {
+                for (const triangle_shape& it_triangle : quad_triangles(it_face))
+                {
+                    triangles[j] = it_triangle;
+                    shapes[j] = shape{ shape_type::triangle, first_triangle + j, it_face.mat, it_triangle.bounding_box() };
+                    ++j;
+                }
+            }
+        }
+    });
+}
+
+void scene::add_shape_batches(const std::vector<shape_batch>& in_batches)
+{
+    size_t sphere_count = 0;
+    size_t triangle_count = 0;
+    for (const shape_batch& it_batch : in_batches)
+    {
+        sphere_count += it_batch.spheres.size();
+        triangle_count += it_batch.triangles.size();
+    }
+    this->reserve_shapes(sphere_count, triangle_count);
+
+    for (const shape_batch& it_batch : in_batches)
+    {
+        this->add_sphere_shapes(it_batch.spheres.data(), it_batch.sphere_materials.data(), it_batch.spheres.size());
+        this->add_triangle_shapes(it_batch.triangles.data(), it_batch.triangle_materials.data(), it_batch.triangles.size());
+    }
+}
+
+// Models are added in bulk: both arrays grow once and the triangles are filled in on all threads.
+void scene::assemble_model(const model_assembly_info& in_info, const mesh_encoding in_encoding)
+{
+    switch (in_encoding)
+    {
+        case mesh_encoding::indexed:   this->assemble_indexed_model(in_info); break;
+        case mesh_encoding::quantized: this->assemble_quantized_model(in_info); break;
+    }
+}
+
+void scene::assemble_indexed_model(const model_assembly_info& in_info)
+{
+    const size_t vertex_count = in_info.vertices.size();
+    const size_t triangle_count = in_info.triangles.size();
+    const size_t first_vertex = this->mesh_positions.size();
+    const size_t first_triangle = this->mesh_triangle_shapes.size();
+    const size_t first_shape = this->shapes.size();
+    if (first_vertex + vertex_count > size_t(std::numeric_limits<uint32_t>::max()))
+    {
+        throw std::runtime_error("Too many mesh vertices in the scene.");
+    }
+    this->mesh_positions.resize(first_vertex + vertex_count);
+    this->mesh_normals.resize(first_vertex + vertex_count);
+    this->mesh_mappings.resize(first_vertex + vertex_count);
+    this->mesh_triangle_shapes.resize(first_triangle + triangle_count);
+    this->shapes.resize(first_shape + triangle_count);
+
+    const uint32_t thread_count = build_thread_count();
+    position_3D* positions = this->mesh_positions.data() + first_vertex;
+    direction_3D* normals = this->mesh_normals.data() + first_vertex;
+    barycentric_2D* mappings = this->mesh_mappings.data() + first_vertex;
+    parallel_for(vertex_count, thread_count, [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
         {
-            in_info.origin + vertex_ruf,
-            in_info.origin + vertex_rub,
-            in_info.origin + vertex_lub,
-            in_info.origin + vertex_luf,
-        },
-        { normal_u, normal_u, normal_u, normal_u },
-        { barycentric_2D{ 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f } },
-        in_info.top_face,
+            positions[i] = in_info.vertices[i].position;
+            normals[i] = in_info.vertices[i].normal;
+            mappings[i] = in_info.vertices[i].mapping;
+        }
     });
-    this->assemble_quad({
+
+    mesh_triangle_shape* triangles = this->mesh_triangle_shapes.data() + first_triangle;
+    shape* shapes = this->shapes.data() + first_shape;
+    parallel_for(triangle_count, thread_count, [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
         {
-            in_info.origin + vertex_ldb,
-            in_info.origin + vertex_lub,
-            in_info.origin + vertex_luf,
-            in_info.origin + vertex_ldf,
-        },
-        { normal_l, normal_l, normal_l, normal_l },
-        { barycentric_2D{ 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f } },
-        in_info.left_face,
+            const std::array<uint32_t, 3>& indices = in_info.triangles[i];
+            triangles[i] = mesh_triangle_shape{ {
+                uint32_t(first_vertex + indices[0]),
+                uint32_t(first_vertex + indices[1]),
+                uint32_t(first_vertex + indices[2]), } };
+            const triangle corners{ positions[indices[0]], positions[indices[1]], positions[indices[2]] };
+            shapes[i] = shape{ shape_type::mesh_triangle, first_triangle + i, in_info.mat,
+                triangle_shape{ corners }.bounding_box() };
+        }
     });
-    this->assemble_quad({
+}
+
+void scene::assemble_quantized_model(const model_assembly_info& in_info)
+{
+    const size_t vertex_count = in_info.vertices.size();
+    const size_t triangle_count = in_info.triangles.size();
+    const size_t first_vertex = this->quantized_mesh_vertices.size();
+    const size_t first_triangle = this->quantized_mesh_triangle_shapes.size();
+    const size_t first_node = this->quantized_mesh_hierarchies.size();
+    if (first_vertex + vertex_count > size_t(std::numeric_limits<uint32_t>::max())
+        || first_triangle + triangle_count > size_t(std::numeric_limits<uint32_t>::max())
+        || first_node + (2 * triangle_count) > size_t(std::numeric_limits<uint32_t>::max()))
+    {
+        throw std::runtime_error("Too many quantized mesh triangles in the scene.");
+    }
+    if (triangle_count == 0)
+    {
+        return;
+    }
+
+    position_3D bounds_min{ infinity<float> };
+    position_3D bounds_max{ -infinity<float> };
+    for (const vertex& it_vertex : in_info.vertices)
+    {
+        bounds_min = glm::min(bounds_min, it_vertex.position);
+        bounds_max = glm::max(bounds_max, it_vertex.position);
+    }
+    const quantized_mesh mesh{ bounds_min, (bounds_max - bounds_min) / 65535.f, uint32_t(first_triangle), uint32_t(first_node) };
+    this->quantized_mesh_vertices.resize(first_vertex + vertex_count);
+    this->quantized_mesh_triangle_shapes.resize(first_triangle + triangle_count);
+
+    const uint32_t thread_count = build_thread_count();
+    quantized_vertex* vertices = this->quantized_mesh_vertices.data() + first_vertex;
+    parallel_for(vertex_count, thread_count, [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
         {
-            in_info.origin + vertex_rdb,
-            in_info.origin + vertex_rub,
-            in_info.origin + vertex_ruf,
-            in_info.origin + vertex_rdf,
-        },
-        { normal_r, normal_r, normal_r, normal_r },
-        { barycentric_2D{ 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f } },
-        in_info.right_face,
+            const vertex& it_vertex = in_info.vertices[i];
+            vertices[i] = quantized_vertex{ mesh.quantize(it_vertex.position), pack_octahedral_16(it_vertex.normal),
+                glm::packHalf2x16(it_vertex.mapping) };
+        }
     });
-    this->assemble_quad({
+
+    quantized_mesh_triangle_shape* triangles = this->quantized_mesh_triangle_shapes.data() + first_triangle;
+    parallel_for(triangle_count, thread_count, [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
         {
-            in_info.origin + vertex_rdf,
-            in_info.origin + vertex_ruf,
-            in_info.origin + vertex_luf,
-            in_info.origin + vertex_ldf,
-        },
-        { normal_f, normal_f, normal_f, normal_f },
-        { barycentric_2D{ 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f } },
-        in_info.front_face,
+            const std::array<uint32_t, 3>& indices = in_info.triangles[i];
+            triangles[i] = quantized_mesh_triangle_shape{ {
+                uint32_t(first_vertex + indices[0]),
+                uint32_t(first_vertex + indices[1]),
+                uint32_t(first_vertex + indices[2]), } };
+        }
     });
-    this->assemble_quad({
+
+    // The mesh is a single shape, bounding its positions as they are decoded when intersecting.
+    const bounding_interval_hierarchy nodes = make_hierarchy(triangles, triangle_count, mesh,
+        this->quantized_mesh_vertices.data());
+    this->quantized_mesh_hierarchies.resize(first_node + nodes.size());
+    std::copy(nodes.begin(), nodes.end(), this->quantized_mesh_hierarchies.data() + first_node);
+
+    axis_aligned_box bounding_box = axis_aligned_box::empty();
+    for (size_t i = 0; i < vertex_count; ++i)
+    {
+        const position_3D position = mesh.unpack_position(vertices[i]);
+        bounding_box.extend(axis_aligned_box{ position, position });
+    }
+    this->shapes.push_back(shape{ shape_type::quantized_mesh, this->quantized_meshes.size(), in_info.mat, bounding_box });
+    this->quantized_meshes.push_back(mesh);
+}
+
+// Hierarchy
+
+void scene::build_hierarchy()
+{
+    this->update_bounding_boxes();
+    this->rebuild_hierarchy();
+}
+
+void scene::rebuild_hierarchy()
+{
+    const auto kept_end = std::remove_if(this->shapes.begin(), this->shapes.end(),
+        [](const shape& s) { return s.type == shape_type::none; });
+    this->shapes.resize(size_t(kept_end - this->shapes.begin()));
+
+    if (this->lazy_hierarchy)
+    {
+        this->lazy_hierarchy = make_lazy_hierarchy(this->shapes);
+        this->hierarchy_end_clips.clear();
+        return;
+    }
+    // The nodes are split by the boxes of the whole motion, then refitted to both ends of it.
+    this->hierarchy = make_hierarchy(this->shapes);
+    this->hierarchy_built_cost = this->refit_current_hierarchy().cost;
+}
+
+hierarchy_refit scene::refit_current_hierarchy()
+{
+    if (!this->has_motion())
+    {
+        this->hierarchy_end_clips.clear();
+        return refit_hierarchy(this->hierarchy, this->shapes, build_thread_count());
+    }
+
+    std::vector<min_max<axis_aligned_box>> motion_bounding_boxes(this->shapes.size());
+    const shape* shapes = this->shapes.data();
+    parallel_for(this->shapes.size(), build_thread_count(), [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
         {
-            in_info.origin + vertex_rdb,
-            in_info.origin + vertex_rub,
-            in_info.origin + vertex_lub,
-            in_info.origin + vertex_ldb,
-        },
-        { normal_b, normal_b, normal_b, normal_b },
-        { barycentric_2D{ 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f } },
-        in_info.back_face,
+            motion_bounding_boxes[i] = this->motion_bounding_boxes_of(shapes[i]);
+        }
     });
+    return refit_hierarchy(this->hierarchy, this->hierarchy_end_clips, this->shapes, motion_bounding_boxes,
+        build_thread_count());
 }
 
-void scene::assemble_model(const model_assembly_info& in_info)
+void scene::update_hierarchy()
 {
-    for (size_t i = 0; i < in_info.vertices.size(); i += 3)
+    // Lazy hierarchies only split what rays reach, so rebuilding them is cheap.
+    if (this->lazy_hierarchy || this->hierarchy.empty())
+    {
+        this->build_hierarchy();
+        return;
+    }
+
+    this->update_bounding_boxes();
+    hierarchy_refit refit = this->refit_current_hierarchy();
+    if (refit.covered_shape_count < this->shapes.size())
     {
-        const vertex& a = in_info.vertices[i + 0];
-        const vertex& b = in_info.vertices[i + 1];
-        const vertex& c = in_info.vertices[i + 2];
-        this->add_triangle_shape(
-            triangle{
-                a.position,
-                b.position,
-                c.position,
-            },
-            std::array<direction_3D, 3>{
-                a.normal,
-                b.normal,
-                c.normal,
-            },
-            std::array<barycentric_2D, 3>{
-                a.mapping,
-                b.mapping,
-                c.mapping,
-            },
-            in_info.mat);
+        insert_into_hierarchy(this->hierarchy, this->shapes, refit);
+        refit = this->refit_current_hierarchy();
+    }
+
+    if (this->hierarchy_built_cost <= 0.f)
+    {
+        // Hierarchies assigned directly or loaded from a file are measured on their first update.
+        this->hierarchy_built_cost = refit.cost;
+    }
+    else if (refit.cost > this->hierarchy_built_cost * this->hierarchy_rebuild_threshold)
+    {
+        this->rebuild_hierarchy();
     }
 }
 
@@ -409,9 +775,33 @@ texture scene::add_constant_texture(const color& in_color)
     return this->add_constant_texture(constant_texture{ in_color });
 }
 
+static filtering_method filtering_in_use(const filtering_method in_filtering, const bool in_stochastic)
+{
+    if (in_stochastic)
+    {
+        switch (in_filtering)
+        {
+            case filtering_method::catrom: return filtering_method::stochastic_catrom;
+            case filtering_method::linear: return filtering_method::stochastic_linear;
+            default: break;
+        }
+    }
+    return in_filtering;
+}
+
+// A normal picked by a negative Catmull-Rom weight comes out pointing into the surface, so normal maps
+// only get the stochastic linear filter, whose weights are all positive.
+static filtering_method normal_filtering_in_use(const filtering_method in_filtering, const bool in_stochastic)
+{
+    return in_filtering == filtering_method::linear ? filtering_in_use(in_filtering, in_stochastic) : in_filtering;
+}
+
 texture scene::add_image_texture(const image_texture& in_texture)
 {
     this->image_textures.push_back(in_texture);
+    image_texture& added = this->image_textures.back();
+    added.sampler = sampler_index(filtering_in_use(added.filtering, this->stochastic_filtering), added.wrap,
+        added.image_fragment, this->images[added.image_index].size);
     return texture{ texture_type::image, this->image_textures.size() - 1 };
 }
 
@@ -428,6 +818,21 @@ texture scene::add_image_texture(const array_index in_index, const min_max<textu
     return this->add_image_texture(image_texture{ in_index, in_image_fragment, in_wrap, in_filtering });
 }
 
+void scene::use_stochastic_filtering(const bool in_stochastic)
+{
+    this->stochastic_filtering = in_stochastic;
+    for (image_texture& texture : this->image_textures)
+    {
+        texture.sampler = sampler_index(filtering_in_use(texture.filtering, in_stochastic), texture.wrap,
+            texture.image_fragment, this->images[texture.image_index].size);
+    }
+    for (normal_texture& texture : this->normal_textures)
+    {
+        texture.sampler = sampler_index(normal_filtering_in_use(texture.filtering, in_stochastic), texture.wrap,
+            texture.map_fragment, this->normal_maps[texture.map_index].size);
+    }
+}
+
 texture scene::add_noise_texture(const noise_texture& in_texture)
 {
     this->noise_textures.push_back(in_texture);
@@ -446,6 +851,9 @@ texture scene::add_normal_texture(const normal_texture& in_texture)
         throw std::runtime_error("Clamping a normal map to border is not a good idea.");
     }
     this->normal_textures.push_back(in_texture);
+    normal_texture& added = this->normal_textures.back();
+    added.sampler = sampler_index(normal_filtering_in_use(added.filtering, this->stochastic_filtering), added.wrap,
+        added.map_fragment, this->normal_maps[added.map_index].size);
     return texture{ texture_type::normal, this->normal_textures.size() - 1 };
 }
 
@@ -467,61 +875,217 @@ uint32_t scene::add_image(const image& in_image)
     return this->images.size() - 1;
 }
 
-uint32_t scene::add_image(const std::string_view in_path)
+static std::vector<uint8_t> read_asset_file(const std::string& in_path)
 {
     using namespace std::literals;
-    int32_t width = 0, height = 0, channels = 4;
-    if (uint8_t* data = stbi_load(in_path.data(), &width, &height, &channels, STBI_rgb_alpha))
+    std::ifstream file(in_path, std::ios::binary | std::ios::ate);
+    if (!file)
     {
-        image loaded_image{ extent_2D{ uint32_t(width), uint32_t(height) } };
-        loaded_image.pixels.resize(width * height);
+        throw std::runtime_error("Asset file '"s + in_path + "' not found.");
+    }
+    std::vector<uint8_t> bytes(size_t(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+    return bytes;
+}
 
-        constexpr float normalized_rgb = 1.f / 255.f;
+// FNV-1a
+static uint64_t hash_asset_file(const std::vector<uint8_t>& in_bytes)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const uint8_t byte : in_bytes)
+    {
+        hash = (hash ^ byte) * 1099511628211ull;
+    }
+    return hash;
+}
 
-        for (uint32_t i = 0; i < loaded_image.pixels.size(); ++i)
+static image decode_image(const std::vector<uint8_t>& in_file, const std::string& in_path)
+{
+    using namespace std::literals;
+    int32_t width = 0, height = 0, channels = 3;
+    if (stbi_is_hdr_from_memory(in_file.data(), int32_t(in_file.size())))
+    {
+        if (float* data = stbi_loadf_from_memory(in_file.data(), int32_t(in_file.size()), &width, &height, &channels, STBI_rgb))
         {
-            const color pixel = {
-                float(data[4 * i + 0]) * normalized_rgb,
-                float(data[4 * i + 1]) * normalized_rgb,
-                float(data[4 * i + 2]) * normalized_rgb,
-            };
-            loaded_image.pixels[i] = pixel;
+            image loaded_image = image::allocate(extent_2D{ uint32_t(width), uint32_t(height) }, texel_format::rgb16f);
+            const size_t texel_count = size_t(width) * height;
+            for (size_t i = 0; i < texel_count; ++i)
+            {
+                loaded_image.set_texel(i, color{ data[3 * i + 0], data[3 * i + 1], data[3 * i + 2] });
+            }
+            loaded_image.generate_mip_levels();
+            loaded_image.set_layout(texel_layout::tiled_4x4);
+
+            stbi_image_free(data);
+            return loaded_image;
         }
+    }
+    else if (uint8_t* data = stbi_load_from_memory(in_file.data(), int32_t(in_file.size()), &width, &height, &channels, STBI_rgb))
+    {
+        image loaded_image = image::allocate(extent_2D{ uint32_t(width), uint32_t(height) }, texel_format::rgb8);
+        std::memcpy(loaded_image.texels.data(), data, loaded_image.texels.size());
+        loaded_image.generate_mip_levels();
+        loaded_image.set_layout(texel_layout::tiled_4x4);
 
         stbi_image_free(data);
-        return this->add_image(std::move(loaded_image));
+        return loaded_image;
     }
-    throw std::runtime_error("Image file '"s + in_path.data() + "' not found.");
-}
-
-uint32_t scene::add_normal_map(const normal_map& in_normal_map)
-{
-    this->normal_maps.push_back(in_normal_map);
-    return this->normal_maps.size() - 1;
+    throw std::runtime_error("Image file '"s + in_path + "' could not be decoded.");
 }
 
-uint32_t scene::add_normal_map(std::string_view in_path)
+static normal_map decode_normal_map(const std::vector<uint8_t>& in_file, const std::string& in_path)
 {
     using namespace std::literals;
-    int32_t width = 0, height = 0, channels = 4;
-    if (uint8_t* data = stbi_load(in_path.data(), &width, &height, &channels, STBI_rgb_alpha))
+    int32_t width = 0, height = 0, channels = 3;
+    if (uint8_t* data = stbi_load_from_memory(in_file.data(), int32_t(in_file.size()), &width, &height, &channels, STBI_rgb))
     {
-        normal_map loaded_normal_map{ extent_2D{ uint32_t(width), uint32_t(height) } };
-        loaded_normal_map.pixels.resize(width * height);
+        normal_map loaded_normal_map = normal_map::allocate(extent_2D{ uint32_t(width), uint32_t(height) },
+            texel_format::normal_oct16);
 
         constexpr float rgb_to_direction = 2.f / 255.f;
-        for (uint32_t i = 0; i < loaded_normal_map.pixels.size(); ++i)
+        const size_t texel_count = size_t(width) * height;
+        for (size_t i = 0; i < texel_count; ++i)
         {
             const direction_3D normal = {
-                (float(data[4 * i + 0]) * rgb_to_direction) - 1.f,
-                (float(data[4 * i + 1]) * rgb_to_direction) - 1.f,
-                (float(data[4 * i + 2]) * rgb_to_direction) - 1.f,
+                (float(data[3 * i + 0]) * rgb_to_direction) - 1.f,
+                (float(data[3 * i + 1]) * rgb_to_direction) - 1.f,
+                (float(data[3 * i + 2]) * rgb_to_direction) - 1.f,
             };
-            loaded_normal_map.pixels[i] = glm::normalize(normal);
+            loaded_normal_map.set_texel(i, glm::normalize(normal));
         }
+        loaded_normal_map.generate_mip_levels();
+        loaded_normal_map.set_layout(texel_layout::tiled_4x4);
 
         stbi_image_free(data);
-        return this->add_normal_map(std::move(loaded_normal_map));
+        return loaded_normal_map;
+    }
+    throw std::runtime_error("Normal map file '"s + in_path + "' could not be decoded.");
+}
+
+// Files are read and hashed right away, so that a file requested twice, under the same or another
+// path, maps to the same index. Decoding is queued until resolve_assets, cached maps are ready
+// immediately.
+static uint32_t request_vector_map(std::vector<vector_map>& inout_maps, asset_requests& inout_requests,
+    const std::filesystem::path& in_cache_directory, const std::string_view in_path, const std::string_view in_kind,
+    vector_map (*in_decode)(const std::vector<uint8_t>&, const std::string&))
+{
+    using namespace std::literals;
+    std::string path{ in_path };
+    if (const auto found = inout_requests.by_path.find(path); found != inout_requests.by_path.end())
+    {
+        return found->second;
+    }
+
+    const bool is_cached = !in_cache_directory.empty() && std::filesystem::exists(path);
+    const source_stamp stamp = is_cached ? source_stamp::of(path) : source_stamp{};
+    if (is_cached)
+    {
+        if (std::optional<cached_vector_map> cached = load_cached_vector_map(in_cache_directory, path, in_kind, stamp))
+        {
+            if (const auto found = inout_requests.by_content.find(cached->content_hash); found != inout_requests.by_content.end())
+            {
+                inout_requests.by_path.emplace(std::move(path), found->second);
+                return found->second;
+            }
+
+            const uint32_t index = inout_maps.size();
+            inout_maps.push_back(std::move(cached->map));
+            inout_requests.by_path.emplace(std::move(path), index);
+            inout_requests.by_content.emplace(cached->content_hash, index);
+            return index;
+        }
+    }
+
+    std::vector<uint8_t> file = read_asset_file(path);
+    const uint64_t hash = hash_asset_file(file);
+    if (const auto found = inout_requests.by_content.find(hash); found != inout_requests.by_content.end())
+    {
+        inout_requests.by_path.emplace(std::move(path), found->second);
+        return found->second;
+    }
+
+    // The size is known before decoding, since textures need it to cover the whole map.
+    int32_t width = 0, height = 0, channels = 0;
+    if (!stbi_info_from_memory(file.data(), int32_t(file.size()), &width, &height, &channels))
+    {
+        throw std::runtime_error("Asset file '"s + path + "' is not a supported image.");
+    }
+
+    const uint32_t index = inout_maps.size();
+    inout_maps.push_back(vector_map{ extent_2D{ uint32_t(width), uint32_t(height) }, texel_format::rgb8, texel_layout::linear });
+    inout_requests.by_path.emplace(path, index);
+    inout_requests.by_content.emplace(hash, index);
+    inout_requests.to_decode.emplace_back(index,
+        [=, kind = std::string{ in_kind }, file = std::move(file), path = std::move(path)]() {
+            vector_map decoded_map = in_decode(file, path);
+            if (is_cached)
+            {
+                store_cached_vector_map(in_cache_directory, path, kind, stamp, decoded_map, hash);
+
+                // Mapping the stored file releases the decoded texels, and lets them be paged right away.
+                if (std::optional<cached_vector_map> stored = load_cached_vector_map(in_cache_directory, path, kind, stamp))
+                {
+                    return std::move(stored->map);
+                }
+            }
+            return decoded_map;
+        });
+    return index;
+}
+
+static void resolve_vector_maps(std::vector<vector_map>& inout_maps, asset_requests& inout_requests)
+{
+    parallel_for(inout_requests.to_decode.size(), build_thread_count(), [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
+        {
+            const auto& [index, decode] = inout_requests.to_decode[i];
+            inout_maps[index] = decode();
+        }
+    });
+    inout_requests.to_decode.clear();
+}
+
+uint32_t scene::add_image(const std::string_view in_path)
+{
+    return request_vector_map(this->images, this->image_requests, this->texture_cache_directory, in_path, "image",
+        decode_image);
+}
+
+uint32_t scene::add_normal_map(const normal_map& in_normal_map)
+{
+    this->normal_maps.push_back(in_normal_map);
+    return this->normal_maps.size() - 1;
+}
+
+uint32_t scene::add_normal_map(const std::string_view in_path)
+{
+    return request_vector_map(this->normal_maps, this->normal_map_requests, this->texture_cache_directory, in_path,
+        "normal_map", decode_normal_map);
+}
+
+void scene::resolve_assets()
+{
+    resolve_vector_maps(this->images, this->image_requests);
+    resolve_vector_maps(this->normal_maps, this->normal_map_requests);
+}
+
+void scene::page_textures(const std::shared_ptr<page_cache>& in_pages)
+{
+    this->texture_pages = in_pages;
+    size_t resident_count = 0;
+    for (image& it_image : this->images)
+    {
+        resident_count += it_image.page_texels(in_pages) ? 0 : 1;
+    }
+    for (normal_map& it_normal_map : this->normal_maps)
+    {
+        resident_count += it_normal_map.page_texels(in_pages) ? 0 : 1;
+    }
+    if (resident_count > 0)
+    {
+        std::cerr << resident_count << " textures stay in memory, only textures mapped from the texture cache can be paged."
+            << std::endl;
     }
-    throw std::runtime_error("Normal map file '"s + in_path.data() + "' not found.");
 }
\ No newline at end of file
@@ -0,0 +1,489 @@
+#include <render_objects/scene_file.hpp>
+
+#include <util/mapped_file.hpp>
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+// Increment whenever the file layout below changes. Changes to the stored structures are caught by
+// the element sizes in the section table.
+static constexpr uint32_t scene_file_version = 5;
+static constexpr std::array<char, 8> scene_file_magic = { 'E', 'R', 'U', 'P', 'S', 'C', 'N', '\0' };
+static constexpr size_t section_alignment = 64;
+
+enum class scene_section : uint32_t
+{
+    camera,
+    sky,
+    hierarchy,
+    hierarchy_end_clips,
+    infinite_shapes,
+    shapes,
+    sphere_shapes,
+    plane_shapes,
+    triangle_shapes,
+    mesh_triangle_shapes,
+    mesh_positions,
+    mesh_normals,
+    mesh_mappings,
+    quantized_mesh_triangle_shapes,
+    quantized_mesh_vertices,
+    quantized_meshes,
+    quantized_mesh_hierarchies,
+    motion_time,
+    moving_sphere_shapes,
+    mesh_end_positions,
+    dielectric_materials,
+    diffuse_materials,
+    emit_light_materials,
+    reflect_materials,
+    checker_textures,
+    constant_textures,
+    image_textures,
+    noise_textures,
+    normal_textures,
+    images,
+    normal_maps,
+    mip_levels,
+    texels,
+    count,
+};
+
+struct scene_file_header
+{
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t section_count;
+    extent_2D<uint32_t> image_size;
+    uint32_t stochastic_filtering;
+    uint32_t padding;
+};
+
+struct section_entry
+{
+    scene_section section;
+    uint32_t element_size;
+    uint64_t offset;
+    uint64_t count;
+};
+
+// Images and normal maps point into the mip levels and texels sections.
+struct stored_vector_map
+{
+    extent_2D<uint32_t> size;
+    texel_format format;
+    texel_layout layout;
+    uint64_t first_level;
+    uint64_t level_count;
+    uint64_t texels_offset;
+    uint64_t texels_size;
+};
+
+static size_t aligned(const size_t in_offset)
+{
+    return (in_offset + section_alignment - 1) / section_alignment * section_alignment;
+}
+
+// Saving
+
+struct section_part
+{
+    size_t offset;
+    const uint8_t* data;
+    size_t size;
+};
+
+class section_writer
+{
+public:
+    section_writer()
+        : sections(size_t(scene_section::count))
+        , offset(aligned(sizeof(scene_file_header) + (size_t(scene_section::count) * sizeof(section_entry))))
+    {
+    }
+
+    template <typename T>
+    void add(const scene_section in_section, const T* in_elements, const size_t in_count)
+    {
+        const size_t size = in_count * sizeof(T);
+        this->sections[size_t(in_section)] = section_entry{ in_section, uint32_t(sizeof(T)), this->offset, in_count };
+        this->parts.push_back({ this->offset, reinterpret_cast<const uint8_t*>(in_elements), size });
+        this->end = this->offset + size;
+        this->offset = aligned(this->end);
+    }
+
+    template <typename T, typename Allocator>
+    void add(const scene_section in_section, const mapped_array<T, Allocator>& in_elements)
+    {
+        this->add(in_section, in_elements.data(), in_elements.size());
+    }
+
+    // A section of bytes made of parts placed at offsets within it, in increasing order.
+    void add(const scene_section in_section, const size_t in_size, const std::vector<section_part>& in_parts)
+    {
+        this->sections[size_t(in_section)] = section_entry{ in_section, 1, this->offset, in_size };
+        for (const section_part& it_part : in_parts)
+        {
+            this->parts.push_back({ this->offset + it_part.offset, it_part.data, it_part.size });
+        }
+        this->end = this->offset + in_size;
+        this->offset = aligned(this->end);
+    }
+
+    bool write(std::ofstream& out_file, const scene_file_header& in_header) const
+    {
+        const std::vector<char> padding(section_alignment, 0);
+        out_file.write(reinterpret_cast<const char*>(&in_header), sizeof(in_header));
+        out_file.write(reinterpret_cast<const char*>(this->sections.data()), this->sections.size() * sizeof(section_entry));
+        size_t written = sizeof(in_header) + (this->sections.size() * sizeof(section_entry));
+        for (const section_part& it_part : this->parts)
+        {
+            out_file.write(padding.data(), it_part.offset - written);
+            out_file.write(reinterpret_cast<const char*>(it_part.data), it_part.size);
+            written = it_part.offset + it_part.size;
+        }
+        out_file.write(padding.data(), this->end - written);
+        return bool(out_file);
+    }
+
+private:
+    std::vector<section_entry> sections;
+    std::vector<section_part> parts;
+    size_t offset;
+    size_t end = 0;
+};
+
+// Paged texels are not contiguous in memory, they are read into the scratch space.
+static void store_vector_maps(const std::vector<vector_map>& in_maps, std::vector<stored_vector_map>& out_stored,
+    std::vector<mip_level>& out_levels, std::vector<section_part>& out_texels, std::vector<std::vector<uint8_t>>& out_scratch,
+    size_t& inout_texels_size)
+{
+    for (const vector_map& it_map : in_maps)
+    {
+        const uint8_t* texels = it_map.texels.data();
+        if (it_map.texels.is_paged())
+        {
+            std::vector<uint8_t>& scratch = out_scratch.emplace_back(it_map.texels.size());
+            texels = it_map.texels.bytes_at(0, it_map.texels.size(), scratch.data());
+        }
+        out_stored.push_back(stored_vector_map{
+            it_map.size, it_map.format, it_map.layout, out_levels.size(), it_map.levels.size(),
+            inout_texels_size, it_map.texels.size() });
+        out_levels.insert(out_levels.end(), it_map.levels.begin(), it_map.levels.end());
+        out_texels.push_back({ inout_texels_size, texels, it_map.texels.size() });
+        inout_texels_size = aligned(inout_texels_size + it_map.texels.size());
+    }
+}
+
+void save_render_plan(const std::filesystem::path& in_file_path, const render_plan& in_plan)
+{
+    using namespace std::literals;
+    const scene& world = in_plan.world;
+    if (!world.image_requests.to_decode.empty() || !world.normal_map_requests.to_decode.empty())
+    {
+        throw std::runtime_error("Scene assets have to be resolved before saving it to '"s + in_file_path.string() + "'.");
+    }
+
+    std::vector<stored_vector_map> stored_images, stored_normal_maps;
+    std::vector<mip_level> levels;
+    std::vector<section_part> texels;
+    std::vector<std::vector<uint8_t>> scratch;
+    size_t texels_size = 0;
+    store_vector_maps(world.images, stored_images, levels, texels, scratch, texels_size);
+    store_vector_maps(world.normal_maps, stored_normal_maps, levels, texels, scratch, texels_size);
+
+    section_writer writer;
+    writer.add(scene_section::camera, &in_plan.cam, 1);
+    writer.add(scene_section::sky, &world.sky, 1);
+    const bounding_interval_hierarchy expanded_hierarchy = world.lazy_hierarchy ? world.lazy_hierarchy->expand_all()
+        : bounding_interval_hierarchy{};
+    writer.add(scene_section::hierarchy, world.lazy_hierarchy ? expanded_hierarchy : world.hierarchy);
+    writer.add(scene_section::hierarchy_end_clips, world.hierarchy_end_clips);
+    writer.add(scene_section::infinite_shapes, world.infinite_shapes);
+    writer.add(scene_section::shapes, world.shapes);
+    writer.add(scene_section::sphere_shapes, world.sphere_shapes);
+    writer.add(scene_section::plane_shapes, world.plane_shapes);
+    writer.add(scene_section::triangle_shapes, world.triangle_shapes);
+    writer.add(scene_section::mesh_triangle_shapes, world.mesh_triangle_shapes);
+    writer.add(scene_section::mesh_positions, world.mesh_positions);
+    writer.add(scene_section::mesh_normals, world.mesh_normals);
+    writer.add(scene_section::mesh_mappings, world.mesh_mappings);
+    writer.add(scene_section::quantized_mesh_triangle_shapes, world.quantized_mesh_triangle_shapes);
+    writer.add(scene_section::quantized_mesh_vertices, world.quantized_mesh_vertices);
+    writer.add(scene_section::quantized_meshes, world.quantized_meshes);
+    writer.add(scene_section::quantized_mesh_hierarchies, world.quantized_mesh_hierarchies);
+    writer.add(scene_section::motion_time, &world.motion_time, 1);
+    writer.add(scene_section::moving_sphere_shapes, world.moving_sphere_shapes);
+    writer.add(scene_section::mesh_end_positions, world.mesh_end_positions);
+    writer.add(scene_section::dielectric_materials, world.dielectric_materials);
+    writer.add(scene_section::diffuse_materials, world.diffuse_materials);
+    writer.add(scene_section::emit_light_materials, world.emit_light_materials);
+    writer.add(scene_section::reflect_materials, world.reflect_materials);
+    writer.add(scene_section::checker_textures, world.checker_textures);
+    writer.add(scene_section::constant_textures, world.constant_textures);
+    writer.add(scene_section::image_textures, world.image_textures);
+    writer.add(scene_section::noise_textures, world.noise_textures);
+    writer.add(scene_section::normal_textures, world.normal_textures);
+    writer.add(scene_section::images, stored_images.data(), stored_images.size());
+    writer.add(scene_section::normal_maps, stored_normal_maps.data(), stored_normal_maps.size());
+    writer.add(scene_section::mip_levels, levels.data(), levels.size());
+    writer.add(scene_section::texels, texels_size, texels);
+
+    const scene_file_header header = {
+        scene_file_magic,
+        scene_file_version,
+        uint32_t(scene_section::count),
+        in_plan.image_size,
+        uint32_t(world.stochastic_filtering),
+        0,
+    };
+
+    // Written under a temporary name and renamed, so concurrent renders never map a partial file.
+    std::error_code error;
+    if (in_file_path.has_parent_path())
+    {
+        std::filesystem::create_directories(in_file_path.parent_path(), error);
+    }
+    std::filesystem::path temporary_path = in_file_path;
+    temporary_path += "." + std::to_string(std::random_device{}()) + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary);
+        if (!writer.write(file, header))
+        {
+            std::cerr << "Could not write scene file " << temporary_path << "." << std::endl;
+            std::filesystem::remove(temporary_path, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary_path, in_file_path, error);
+    if (error)
+    {
+        std::cerr << "Could not write scene file " << in_file_path << "." << std::endl;
+        std::filesystem::remove(temporary_path, error);
+    }
+}
+
+// Loading
+
+class section_reader
+{
+public:
+    explicit section_reader(std::shared_ptr<const mapped_file> in_file)
+        : file(std::move(in_file))
+    {
+    }
+
+    bool read_table(const scene_file_header& in_header)
+    {
+        const size_t table_size = size_t(in_header.section_count) * sizeof(section_entry);
+        if (in_header.section_count != uint32_t(scene_section::count)
+            || sizeof(scene_file_header) + table_size > this->file->size())
+        {
+            return false;
+        }
+        this->sections.resize(in_header.section_count);
+        std::memcpy(this->sections.data(), this->file->data() + sizeof(scene_file_header), table_size);
+        for (size_t i = 0; i < this->sections.size(); ++i)
+        {
+            const section_entry& entry = this->sections[i];
+            if (entry.section != scene_section(i)
+                || entry.offset % section_alignment != 0
+                || entry.offset > this->file->size()
+                || (entry.element_size > 0 && entry.count > (this->file->size() - entry.offset) / entry.element_size))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Null if the stored elements have a different size, which means the structure has changed.
+    template <typename T>
+    const T* elements(const scene_section in_section) const
+    {
+        const section_entry& entry = this->sections[size_t(in_section)];
+        if (entry.element_size != sizeof(T))
+        {
+            return nullptr;
+        }
+        return reinterpret_cast<const T*>(this->file->data() + entry.offset);
+    }
+
+    size_t count(const scene_section in_section) const
+    {
+        return this->sections[size_t(in_section)].count;
+    }
+
+    template <typename T, typename Allocator>
+    bool map(const scene_section in_section, mapped_array<T, Allocator>& out_array) const
+    {
+        const T* elements = this->elements<T>(in_section);
+        if (!elements)
+        {
+            return false;
+        }
+        out_array = mapped_array<T, Allocator>(this->file, elements, this->count(in_section));
+        return true;
+    }
+
+    template <typename T>
+    bool copy(const scene_section in_section, T& out_value) const
+    {
+        const T* elements = this->elements<T>(in_section);
+        if (!elements || this->count(in_section) != 1)
+        {
+            return false;
+        }
+        std::memcpy(&out_value, elements, sizeof(T));
+        return true;
+    }
+
+    bool map_vector_maps(const scene_section in_section, std::vector<vector_map>& out_maps) const
+    {
+        const stored_vector_map* stored = this->elements<stored_vector_map>(in_section);
+        const mip_level* levels = this->elements<mip_level>(scene_section::mip_levels);
+        const uint8_t* texels = this->elements<uint8_t>(scene_section::texels);
+        if (!stored || !levels || !texels)
+        {
+            return false;
+        }
+
+        const size_t level_count = this->count(scene_section::mip_levels);
+        const size_t texels_size = this->count(scene_section::texels);
+        out_maps.reserve(this->count(in_section));
+        for (size_t i = 0; i < this->count(in_section); ++i)
+        {
+            const stored_vector_map& it_map = stored[i];
+            if (it_map.first_level > level_count
+                || it_map.level_count > level_count - it_map.first_level
+                || it_map.texels_offset > texels_size
+                || it_map.texels_size > texels_size - it_map.texels_offset)
+            {
+                return false;
+            }
+            out_maps.push_back(vector_map{
+                it_map.size,
+                it_map.format,
+                it_map.layout,
+                byte_buffer(this->file, texels + it_map.texels_offset, it_map.texels_size),
+                std::vector<mip_level>(levels + it_map.first_level, levels + it_map.first_level + it_map.level_count),
+            });
+            if (!out_maps.back().has_consistent_levels())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::shared_ptr<const mapped_file> file;
+    std::vector<section_entry> sections;
+};
+
+static bool has_valid_texture_references(const scene& in_world)
+{
+    const auto has_valid_methods = [](const auto& in_texture) {
+        return uint32_t(in_texture.wrap) <= uint32_t(wrap_method::repeat)
+            && uint32_t(in_texture.filtering) <= uint32_t(filtering_method::stochastic_linear);
+    };
+    for (const image_texture& it_texture : in_world.image_textures)
+    {
+        if (it_texture.image_index >= in_world.images.size() || !has_valid_methods(it_texture))
+        {
+            return false;
+        }
+    }
+    for (const normal_texture& it_texture : in_world.normal_textures)
+    {
+        if (it_texture.map_index >= in_world.normal_maps.size() || !has_valid_methods(it_texture))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::optional<render_plan> load_render_plan(const std::filesystem::path& in_file_path)
+{
+    std::error_code error;
+    if (!std::filesystem::exists(in_file_path, error))
+    {
+        return std::nullopt;
+    }
+
+    std::shared_ptr<const mapped_file> file;
+    try
+    {
+        file = std::make_shared<const mapped_file>(in_file_path.string());
+    }
+    catch (const std::runtime_error&)
+    {
+        return std::nullopt;
+    }
+
+    scene_file_header header;
+    if (file->size() < sizeof(header))
+    {
+        return std::nullopt;
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (header.magic != scene_file_magic || header.version != scene_file_version)
+    {
+        return std::nullopt;
+    }
+
+    section_reader reader(file);
+    if (!reader.read_table(header))
+    {
+        return std::nullopt;
+    }
+
+    render_plan plan;
+    plan.image_size = header.image_size;
+    scene& world = plan.world;
+    world.stochastic_filtering = header.stochastic_filtering != 0;
+    const bool is_complete = reader.copy(scene_section::camera, plan.cam)
+        && reader.copy(scene_section::sky, world.sky)
+        && reader.map(scene_section::hierarchy, world.hierarchy)
+        && reader.map(scene_section::hierarchy_end_clips, world.hierarchy_end_clips)
+        && reader.map(scene_section::infinite_shapes, world.infinite_shapes)
+        && reader.map(scene_section::shapes, world.shapes)
+        && reader.map(scene_section::sphere_shapes, world.sphere_shapes)
+        && reader.map(scene_section::plane_shapes, world.plane_shapes)
+        && reader.map(scene_section::triangle_shapes, world.triangle_shapes)
+        && reader.map(scene_section::mesh_triangle_shapes, world.mesh_triangle_shapes)
+        && reader.map(scene_section::mesh_positions, world.mesh_positions)
+        && reader.map(scene_section::mesh_normals, world.mesh_normals)
+        && reader.map(scene_section::mesh_mappings, world.mesh_mappings)
+        && reader.map(scene_section::quantized_mesh_triangle_shapes, world.quantized_mesh_triangle_shapes)
+        && reader.map(scene_section::quantized_mesh_vertices, world.quantized_mesh_vertices)
+        && reader.map(scene_section::quantized_meshes, world.quantized_meshes)
+        && reader.map(scene_section::quantized_mesh_hierarchies, world.quantized_mesh_hierarchies)
+        && reader.copy(scene_section::motion_time, world.motion_time)
+        && reader.map(scene_section::moving_sphere_shapes, world.moving_sphere_shapes)
+        && reader.map(scene_section::mesh_end_positions, world.mesh_end_positions)
+        && reader.map(scene_section::dielectric_materials, world.dielectric_materials)
+        && reader.map(scene_section::diffuse_materials, world.diffuse_materials)
+        && reader.map(scene_section::emit_light_materials, world.emit_light_materials)
+        && reader.map(scene_section::reflect_materials, world.reflect_materials)
+        && reader.map(scene_section::checker_textures, world.checker_textures)
+        && reader.map(scene_section::constant_textures, world.constant_textures)
+        && reader.map(scene_section::image_textures, world.image_textures)
+        && reader.map(scene_section::noise_textures, world.noise_textures)
+        && reader.map(scene_section::normal_textures, world.normal_textures)
+        && reader.map_vector_maps(scene_section::images, world.images)
+        && reader.map_vector_maps(scene_section::normal_maps, world.normal_maps);
+    if (!is_complete || !has_valid_texture_references(world))
+    {
+        return std::nullopt;
+    }
+
+    // Stored sampler indices point into the sampler table of the build that saved the file, so they are
+    // picked again from the filtering and wrap methods.
+    world.use_stochastic_filtering(world.stochastic_filtering);
+    return plan;
+}
\ No newline at end of file
@@ -1,76 +1,644 @@
 #include <render_objects/shape_assembly.hpp>
 
-#include <external/tiny_obj_loader.h>
-
-static void read_vertices_untextured(const tinyobj::attrib_t& in_attributes,
-    const std::vector<tinyobj::shape_t>& in_shapes, model_assembly_info& out_info)
-{
-    for (const tinyobj::shape_t& shape : in_shapes)
-    {
-        for (const tinyobj::index_t& index : shape.mesh.indices)
-        {
-            out_info.vertices.push_back(vertex{
-                position_3D{
-                    in_attributes.vertices[3 * index.vertex_index + 0],
-                    in_attributes.vertices[3 * index.vertex_index + 1],
-                    in_attributes.vertices[3 * index.vertex_index + 2],
-                },
-                direction_3D{
-                    in_attributes.normals[3 * index.normal_index + 0],
-                    in_attributes.normals[3 * index.normal_index + 1],
-                    in_attributes.normals[3 * index.normal_index + 2],
-                },
-                barycentric_2D{ -1.f, -1.f },
-            });
+#include <util/mapped_file.hpp>
+#include <util/parallel.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+// Quads and cuboids
+
+std::array<triangle_shape, 2> quad_triangles(const quad_assembly_info& in_info)
+{
+    std::array<triangle_shape, 2> triangles;
+    for (size_t i = 0; i <= 2; i += 2)
+    {
+        const size_t j_0 = i;
+        const size_t j_1 = i + 1;
+        const size_t j_2 = (i + 2) % 4;
+        triangles[i / 2] = triangle_shape{
+            triangle{
+                in_info.vertices[j_0],
+                in_info.vertices[j_1],
+                in_info.vertices[j_2],
+            },
+            in_info.normals[j_0], in_info.normals[j_1], in_info.normals[j_2],
+            in_info.mappings[j_0], in_info.mappings[j_1], in_info.mappings[j_2],
+        };
+    }
+    return triangles;
+}
+
+std::array<quad_assembly_info, 6> cuboid_faces(const cuboid_assembly_info& in_info)
+{
+    const float width = in_info.half_size.width;
+    const float height = in_info.half_size.height;
+    const float depth = in_info.half_size.depth;
+    const float face_sign = in_info.face_inwards ? -1.f : 1.f;
+
+    const direction_3D normal_d = (-y_axis * in_info.rotation) * face_sign;
+    const direction_3D normal_u = (+y_axis * in_info.rotation) * face_sign;
+    const direction_3D normal_l = (-x_axis * in_info.rotation) * face_sign;
+    const direction_3D normal_r = (+x_axis * in_info.rotation) * face_sign;
+    const direction_3D normal_f = (-z_axis * in_info.rotation) * face_sign;
+    const direction_3D normal_b = (+z_axis * in_info.rotation) * face_sign;
+
+    const displacement_3D vertex_ldf = in_info.rotation * displacement_3D{ -width, -height, -depth };
+    const displacement_3D vertex_ldb = in_info.rotation * displacement_3D{ -width, -height, +depth };
+    const displacement_3D vertex_luf = in_info.rotation * displacement_3D{ -width, +height, -depth };
+    const displacement_3D vertex_lub = in_info.rotation * displacement_3D{ -width, +height, +depth };
+    const displacement_3D vertex_rdf = in_info.rotation * displacement_3D{ +width, -height, -depth };
+    const displacement_3D vertex_rdb = in_info.rotation * displacement_3D{ +width, -height, +depth };
+    const displacement_3D vertex_ruf = in_info.rotation * displacement_3D{ +width, +height, -depth };
+    const displacement_3D vertex_rub = in_info.rotation * displacement_3D{ +width, +height, +depth };
+
+    return {
+        quad_assembly_info{
+            {
+                in_info.origin + vertex_rdf,
+                in_info.origin + vertex_rdb,
+                in_info.origin + vertex_ldb,
+                in_info.origin + vertex_ldf,
+            },
+            { normal_d, normal_d, normal_d, normal_d },
+            { barycentric_2D{ 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f } },
+            in_info.bottom_face,
+        },
+        quad_assembly_info{
+            {
+                in_info.origin + vertex_ruf,
+                in_info.origin + vertex_rub,
+                in_info.origin + vertex_lub,
+                in_info.origin + vertex_luf,
+            },
+            { normal_u, normal_u, normal_u, normal_u },
+            { barycentric_2D{ 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f } },
+            in_info.top_face,
+        },
+        quad_assembly_info{
+            {
+                in_info.origin + vertex_ldb,
+                in_info.origin + vertex_lub,
+                in_info.origin + vertex_luf,
+                in_info.origin + vertex_ldf,
+            },
+            { normal_l, normal_l, normal_l, normal_l },
+            { barycentric_2D{ 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f } },
+            in_info.left_face,
+        },
+        quad_assembly_info{
+            {
+                in_info.origin + vertex_rdb,
+                in_info.origin + vertex_rub,
+                in_info.origin + vertex_ruf,
+                in_info.origin + vertex_rdf,
+            },
+            { normal_r, normal_r, normal_r, normal_r },
+            { barycentric_2D{ 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f } },
+            in_info.right_face,
+        },
+        quad_assembly_info{
+            {
+                in_info.origin + vertex_rdf,
+                in_info.origin + vertex_ruf,
+                in_info.origin + vertex_luf,
+                in_info.origin + vertex_ldf,
+            },
+            { normal_f, normal_f, normal_f, normal_f },
+            { barycentric_2D{ 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f } },
+            in_info.front_face,
+        },
+        quad_assembly_info{
+            {
+                in_info.origin + vertex_rdb,
+                in_info.origin + vertex_rub,
+                in_info.origin + vertex_lub,
+                in_info.origin + vertex_ldb,
+            },
+            { normal_b, normal_b, normal_b, normal_b },
+            { barycentric_2D{ 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f } },
+            in_info.back_face,
+        },
+    };
+}
+
+// Shape batches
+
+void shape_batch::add_sphere_shape(const sphere_shape& in_sphere, const material& in_material)
+{
+    this->spheres.push_back(in_sphere);
+    this->sphere_materials.push_back(in_material);
+}
+
+void shape_batch::add_triangle_shape(const triangle_shape& in_triangle, const material& in_material)
+{
+    this->triangles.push_back(in_triangle);
+    this->triangle_materials.push_back(in_material);
+}
+
+void shape_batch::assemble_quad(const quad_assembly_info& in_info)
+{
+    for (const triangle_shape& it_triangle : quad_triangles(in_info))
+    {
+        this->add_triangle_shape(it_triangle, in_info.mat);
+    }
+}
+
+void shape_batch::assemble_cuboid(const cuboid_assembly_info& in_info)
+{
+    for (const quad_assembly_info& it_face : cuboid_faces(in_info))
+    {
+        this->assemble_quad(it_face);
+    }
+}
+
+// OBJ parsing
+
+static constexpr size_t min_chunk_size = 1024 * 1024;
+
+struct obj_corner
+{
+    int32_t position;
+    int32_t mapping;
+    int32_t normal;
+};
+
+// What a chunk of lines defines, counted in the first pass and filled in the second.
+struct obj_chunk
+{
+    const char* begin;
+    const char* end;
+    size_t position_count = 0;
+    size_t normal_count = 0;
+    size_t mapping_count = 0;
+    size_t triangle_count = 0;
+};
+
+struct obj_attributes
+{
+    std::vector<position_3D> positions;
+    std::vector<direction_3D> normals;
+    std::vector<barycentric_2D> mappings;
+    std::vector<std::array<obj_corner, 3>> triangles;
+};
+
+static const char* skip_spaces(const char* in_it, const char* in_end)
+{
+    while (in_it < in_end && (*in_it == ' ' || *in_it == '\t'))
+    {
+        ++in_it;
+    }
+    return in_it;
+}
+
+static const char* line_end(const char* in_it, const char* in_end)
+{
+    const void* found = std::memchr(in_it, '\n', in_end - in_it);
+    return found ? static_cast<const char*>(found) : in_end;
+}
+
+static const char* read_float(const char* in_it, const char* in_end, float& out_value)
+{
+    in_it = skip_spaces(in_it, in_end);
+    if (in_it < in_end && *in_it == '+')
+    {
+        ++in_it;
+    }
+    const std::from_chars_result result = std::from_chars(in_it, in_end, out_value);
+    if (result.ec != std::errc{})
+    {
+        out_value = 0.f;
+    }
+    return result.ptr;
+}
+
+// Indices are one-based, negative ones count back from the last defined element. Missing indices are -1.
+static const char* read_index(const char* in_it, const char* in_end, const size_t in_defined_count, int32_t& out_index)
+{
+    int64_t index = 0;
+    const std::from_chars_result result = std::from_chars(in_it, in_end, index);
+    if (result.ec != std::errc{} || index == 0)
+    {
+        out_index = -1;
+        return result.ptr;
+    }
+    out_index = int32_t(index > 0 ? index - 1 : int64_t(in_defined_count) + index);
+    return result.ptr;
+}
+
+static const char* read_corner(const char* in_it, const char* in_end, const obj_chunk& in_defined, obj_corner& out_corner)
+{
+    out_corner = obj_corner{ -1, -1, -1 };
+    in_it = read_index(in_it, in_end, in_defined.position_count, out_corner.position);
+    if (in_it < in_end && *in_it == '/')
+    {
+        in_it = read_index(in_it + 1, in_end, in_defined.mapping_count, out_corner.mapping);
+        if (in_it < in_end && *in_it == '/')
+        {
+            in_it = read_index(in_it + 1, in_end, in_defined.normal_count, out_corner.normal);
         }
     }
+    return in_it;
 }
 
-static void read_vertices_textured(const tinyobj::attrib_t& in_attributes,
-    const std::vector<tinyobj::shape_t>& in_shapes, model_assembly_info& out_info)
+static bool is_space_or_end(const char* in_it, const char* in_end)
 {
-    for (const tinyobj::shape_t& shape : in_shapes)
+    return in_it == in_end || *in_it == ' ' || *in_it == '\t' || *in_it == '\r';
+}
+
+static size_t count_face_corners(const char* in_it, const char* in_end)
+{
+    size_t corner_count = 0;
+    while ((in_it = skip_spaces(in_it, in_end)) < in_end && *in_it != '\r' && *in_it != '#')
     {
-        for (const tinyobj::index_t& index : shape.mesh.indices)
+        ++corner_count;
+        while (!is_space_or_end(in_it, in_end))
         {
-            out_info.vertices.push_back(vertex{
-                position_3D{
-                    in_attributes.vertices[3 * index.vertex_index + 0],
-                    in_attributes.vertices[3 * index.vertex_index + 1],
-                    in_attributes.vertices[3 * index.vertex_index + 2],
-                },
-                direction_3D{
-                    in_attributes.normals[3 * index.normal_index + 0],
-                    in_attributes.normals[3 * index.normal_index + 1],
-                    in_attributes.normals[3 * index.normal_index + 2],
-                },
-                barycentric_2D{
-                    in_attributes.texcoords[2 * index.texcoord_index + 0],
-                    in_attributes.texcoords[2 * index.texcoord_index + 1],
-                },
-            });
+            ++in_it;
+        }
+    }
+    return corner_count;
+}
+
+// Counts what the chunk defines when out_attributes is null, otherwise writes it at the offsets the
+// previous chunks end at, given in inout_defined.
+static void parse_obj_chunk(obj_chunk& inout_defined, const obj_chunk& in_chunk, obj_attributes* out_attributes)
+{
+    for (const char* it = in_chunk.begin; it < in_chunk.end;)
+    {
+        const char* end = line_end(it, in_chunk.end);
+        it = skip_spaces(it, end);
+        if (end - it >= 2 && it[0] == 'v' && (it[1] == ' ' || it[1] == '\t'))
+        {
+            if (out_attributes)
+            {
+                position_3D& position = out_attributes->positions[inout_defined.position_count];
+                it = read_float(it + 2, end, position.x);
+                it = read_float(it, end, position.y);
+                it = read_float(it, end, position.z);
+            }
+            ++inout_defined.position_count;
+        }
+        else if (end - it >= 3 && it[0] == 'v' && it[1] == 'n' && (it[2] == ' ' || it[2] == '\t'))
+        {
+            if (out_attributes)
+            {
+                direction_3D& normal = out_attributes->normals[inout_defined.normal_count];
+                it = read_float(it + 3, end, normal.x);
+                it = read_float(it, end, normal.y);
+                it = read_float(it, end, normal.z);
+            }
+            ++inout_defined.normal_count;
+        }
+        else if (end - it >= 3 && it[0] == 'v' && it[1] == 't' && (it[2] == ' ' || it[2] == '\t'))
+        {
+            if (out_attributes)
+            {
+                barycentric_2D& mapping = out_attributes->mappings[inout_defined.mapping_count];
+                it = read_float(it + 3, end, mapping.U);
+                it = read_float(it, end, mapping.V);
+            }
+            ++inout_defined.mapping_count;
+        }
+        else if (end - it >= 2 && it[0] == 'f' && (it[1] == ' ' || it[1] == '\t'))
+        {
+            // Polygons are split into a fan of triangles around their first corner.
+            if (!out_attributes)
+            {
+                const size_t corner_count = count_face_corners(it + 2, end);
+                inout_defined.triangle_count += corner_count >= 3 ? corner_count - 2 : 0;
+            }
+            else
+            {
+                std::array<obj_corner, 3> corners;
+                size_t corner_count = 0;
+                it += 2;
+                while ((it = skip_spaces(it, end)) < end && *it != '\r' && *it != '#')
+                {
+                    const char* next = read_corner(it, end, inout_defined, corners[std::min<size_t>(corner_count, 2)]);
+                    while (!is_space_or_end(next, end))
+                    {
+                        ++next;
+                    }
+                    it = next;
+                    if (++corner_count >= 3)
+                    {
+                        out_attributes->triangles[inout_defined.triangle_count++] = corners;
+                        corners[1] = corners[2];
+                    }
+                }
+            }
+        }
+        it = end + 1;
+    }
+}
+
+static std::vector<obj_chunk> split_into_chunks(const char* in_begin, const char* in_end, const uint32_t in_thread_count)
+{
+    const size_t size = in_end - in_begin;
+    const size_t chunk_count = std::max<size_t>(1, std::min<size_t>(in_thread_count * 4, size / min_chunk_size));
+
+    std::vector<obj_chunk> chunks;
+    chunks.reserve(chunk_count);
+    const char* begin = in_begin;
+    for (size_t i = 1; i <= chunk_count && begin < in_end; ++i)
+    {
+        const char* end = (i == chunk_count) ? in_end : in_begin + (size * i / chunk_count);
+        end = std::max(end, begin);
+        if (end < in_end)
+        {
+            end = std::min(line_end(end, in_end) + 1, in_end);
         }
+        chunks.push_back(obj_chunk{ begin, end });
+        begin = end;
     }
+    return chunks;
+}
+
+// Vertices
+
+static bool is_degenerate(const position_3D& in_a, const position_3D& in_b, const position_3D& in_c)
+{
+    const displacement_3D normal = glm::cross(in_b - in_a, in_c - in_a);
+    const float area_squared = glm::dot(normal, normal);
+    return !(area_squared > 0.f) || std::isinf(area_squared);
 }
 
-model_assembly_info load_model(const std::string_view in_path)
+static bool is_valid(const int32_t in_index, const size_t in_count)
 {
-    tinyobj::ObjReader model_loader;
+    return in_index >= 0 && size_t(in_index) < in_count;
+}
 
-    if (!model_loader.ParseFromFile(in_path.data()))
+// Area-weighted normals of the faces around each position, for corners without a normal.
+static std::vector<direction_3D> smooth_normals(const obj_attributes& in_attributes,
+    const std::vector<std::array<obj_corner, 3>>& in_triangles)
+{
+    std::vector<direction_3D> normals(in_attributes.positions.size(), direction_3D{ 0.f });
+    for (const std::array<obj_corner, 3>& it_triangle : in_triangles)
+    {
+        const position_3D& a = in_attributes.positions[it_triangle[0].position];
+        const position_3D& b = in_attributes.positions[it_triangle[1].position];
+        const position_3D& c = in_attributes.positions[it_triangle[2].position];
+        const displacement_3D face = glm::cross(b - a, c - a);
+        for (const obj_corner& corner : it_triangle)
+        {
+            normals[corner.position] += face;
+        }
+    }
+    for (direction_3D& it_normal : normals)
+    {
+        const float length = glm::length(it_normal);
+        it_normal = length > 0.f ? it_normal / length : direction_3D{ 0.f, 1.f, 0.f };
+    }
+    return normals;
+}
+
+static vertex vertex_of(const obj_attributes& in_attributes, const std::vector<direction_3D>& in_smooth_normals,
+    const obj_corner& in_corner)
+{
+    return vertex{
+        in_attributes.positions[in_corner.position],
+        is_valid(in_corner.normal, in_attributes.normals.size())
+            ? in_attributes.normals[in_corner.normal] : in_smooth_normals[in_corner.position],
+        is_valid(in_corner.mapping, in_attributes.mappings.size())
+            ? in_attributes.mappings[in_corner.mapping] : barycentric_2D{ -1.f, -1.f },
+    };
+}
+
+static bool operator==(const obj_corner& in_a, const obj_corner& in_b)
+{
+    return in_a.position == in_b.position && in_a.normal == in_b.normal && in_a.mapping == in_b.mapping;
+}
+
+model_assembly_info load_model(const std::string_view in_path, uint32_t in_thread_count)
+{
+    using namespace std::literals;
+    if (in_thread_count == 0)
+    {
+        in_thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    const mapped_file file{ std::string{ in_path } };
+    const char* text = reinterpret_cast<const char*>(file.data());
+    std::vector<obj_chunk> chunks = split_into_chunks(text, text + file.size(), in_thread_count);
+
+    // First pass: count, then place every chunk right after the ones before it.
+    parallel_for(chunks.size(), in_thread_count, [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
+        {
+            obj_chunk counts{ chunks[i].begin, chunks[i].end };
+            parse_obj_chunk(counts, chunks[i], nullptr);
+            chunks[i] = counts;
+        }
+    });
+    std::vector<obj_chunk> chunk_offsets(chunks.size());
+    obj_chunk totals{};
+    for (size_t i = 0; i < chunks.size(); ++i)
     {
-        throw std::runtime_error(model_loader.Warning() + model_loader.Error());
+        chunk_offsets[i] = totals;
+        totals.position_count += chunks[i].position_count;
+        totals.normal_count += chunks[i].normal_count;
+        totals.mapping_count += chunks[i].mapping_count;
+        totals.triangle_count += chunks[i].triangle_count;
     }
 
+    // Second pass: parse into arrays of the exact size.
+    obj_attributes attributes;
+    attributes.positions.resize(totals.position_count);
+    attributes.normals.resize(totals.normal_count);
+    attributes.mappings.resize(totals.mapping_count);
+    attributes.triangles.resize(totals.triangle_count);
+    parallel_for(chunks.size(), in_thread_count, [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t i = in_first; i < in_last; ++i)
+        {
+            parse_obj_chunk(chunk_offsets[i], chunks[i], &attributes);
+        }
+    });
+
+    // Triangles with invalid positions or no area are dropped, the rest are compacted in parallel.
+    const size_t job_count = std::max<size_t>(1, std::min<size_t>(in_thread_count, totals.triangle_count));
+    std::vector<size_t> kept_counts(job_count + 1, 0);
+    const auto is_kept = [&](const std::array<obj_corner, 3>& corners)
+    {
+        for (const obj_corner& corner : corners)
+        {
+            if (!is_valid(corner.position, attributes.positions.size()))
+            {
+                return false;
+            }
+        }
+        return !is_degenerate(attributes.positions[corners[0].position], attributes.positions[corners[1].position],
+            attributes.positions[corners[2].position]);
+    };
+    const auto job_triangles = [&](const size_t job)
+    {
+        return std::make_pair(totals.triangle_count * job / job_count, totals.triangle_count * (job + 1) / job_count);
+    };
+    parallel_for(job_count, in_thread_count, [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t job = in_first; job < in_last; ++job)
+        {
+            for (auto [t, last] = job_triangles(job); t < last; ++t)
+            {
+                kept_counts[job + 1] += is_kept(attributes.triangles[t]) ? 1 : 0;
+            }
+        }
+    });
+    std::partial_sum(kept_counts.begin(), kept_counts.end(), kept_counts.begin());
+
+    // Every corner records which of its attributes it has and whether any of them uses its own index.
+    constexpr uint8_t own_index = 1, with_normal = 2, without_normal = 4, with_mapping = 8, without_mapping = 16;
+    std::vector<std::array<obj_corner, 3>> triangles(kept_counts.back());
+    std::vector<uint8_t> job_corner_kinds(job_count, 0);
+    std::vector<uint8_t> job_misses_normals(job_count, 0);
+    parallel_for(job_count, in_thread_count, [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t job = in_first; job < in_last; ++job)
+        {
+            std::array<obj_corner, 3>* out = triangles.data() + kept_counts[job];
+            for (auto [t, last] = job_triangles(job); t < last; ++t)
+            {
+                if (!is_kept(attributes.triangles[t]))
+                {
+                    continue;
+                }
+                *out++ = attributes.triangles[t];
+                for (const obj_corner& corner : attributes.triangles[t])
+                {
+                    const bool has_normal = corner.normal >= 0, has_mapping = corner.mapping >= 0;
+                    job_corner_kinds[job] |= (has_normal ? with_normal : without_normal) | (has_mapping ? with_mapping : without_mapping)
+                        | ((has_normal && corner.normal != corner.position) || (has_mapping && corner.mapping != corner.position) ? own_index : 0);
+                    job_misses_normals[job] |= !is_valid(corner.normal, attributes.normals.size());
+                }
+            }
+        }
+    });
+
+    const uint8_t corner_kinds = std::accumulate(job_corner_kinds.begin(), job_corner_kinds.end(), uint8_t(0),
+        [](const uint8_t in_a, const uint8_t in_b) { return uint8_t(in_a | in_b); });
+    const bool uses_positions_as_vertices = !(corner_kinds & own_index)
+        && !((corner_kinds & with_normal) && (corner_kinds & without_normal))
+        && !((corner_kinds & with_mapping) && (corner_kinds & without_mapping));
+
+    // Using the positions as vertices also makes vertices of positions no face refers to, which need not
+    // have a normal in the file.
+    const bool needs_smooth_normals = std::find(job_misses_normals.begin(), job_misses_normals.end(), 1) != job_misses_normals.end()
+        || (uses_positions_as_vertices && attributes.normals.size() < attributes.positions.size());
+    const std::vector<direction_3D> normals = needs_smooth_normals ? smooth_normals(attributes, triangles) : std::vector<direction_3D>{};
+
     model_assembly_info info;
-    const tinyobj::attrib_t& attributes = model_loader.GetAttrib();
-    if (attributes.texcoords.empty())
+    info.triangles.resize(triangles.size());
+    if (uses_positions_as_vertices)
+    {
+        // Every corner uses the same index for all its attributes, as scanners and most exporters write
+        // them, so the positions are the vertices.
+        const bool has_normals = corner_kinds & with_normal, has_mappings = corner_kinds & with_mapping;
+        info.vertices.resize(attributes.positions.size());
+        parallel_for(info.vertices.size(), in_thread_count, [&](const size_t in_first, const size_t in_last)
+        {
+            for (size_t i = in_first; i < in_last; ++i)
+            {
+                const int32_t index = int32_t(i);
+                info.vertices[i] = vertex_of(attributes, normals, obj_corner{ index, has_mappings ? index : -1, has_normals ? index : -1 });
+            }
+        });
+        parallel_for(triangles.size(), in_thread_count, [&](const size_t in_first, const size_t in_last)
+        {
+            for (size_t t = in_first; t < in_last; ++t)
+            {
+                for (size_t i = 0; i < 3; ++i)
+                {
+                    info.triangles[t][i] = uint32_t(triangles[t][i].position);
+                }
+            }
+        });
+        return info;
+    }
+
+    // Otherwise there is a vertex for every distinct combination of attributes. Corners are grouped by
+    // position, and every group is sorted so the vertices come out in the same order on every run.
+    const size_t corner_count = 3 * triangles.size();
+    if (corner_count > std::numeric_limits<uint32_t>::max())
     {
-        read_vertices_untextured(attributes, model_loader.GetShapes(), info);
+        throw std::runtime_error("Too many triangles in "s + std::string{ in_path });
     }
-    else
+    const auto corner_at = [&](const uint32_t in_corner) -> const obj_corner& { return triangles[in_corner / 3][in_corner % 3]; };
+    const size_t position_count = attributes.positions.size();
+    std::unique_ptr<std::atomic<uint32_t>[]> group_fills = std::make_unique<std::atomic<uint32_t>[]>(position_count);
+    parallel_for(corner_count, in_thread_count, [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t c = in_first; c < in_last; ++c)
+        {
+            group_fills[corner_at(uint32_t(c)).position].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    std::vector<uint32_t> group_starts(position_count + 1, 0);
+    for (size_t p = 0; p < position_count; ++p)
     {
-        read_vertices_textured(attributes, model_loader.GetShapes(), info);
+        group_starts[p + 1] = group_starts[p] + group_fills[p].exchange(0, std::memory_order_relaxed);
     }
+    std::vector<uint32_t> grouped_corners(corner_count);
+    parallel_for(corner_count, in_thread_count, [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t c = in_first; c < in_last; ++c)
+        {
+            const int32_t position = corner_at(uint32_t(c)).position;
+            grouped_corners[group_starts[position] + group_fills[position].fetch_add(1, std::memory_order_relaxed)] = uint32_t(c);
+        }
+    });
+
+    // Count the distinct corners of every group, then give each of them a vertex.
+    std::vector<uint32_t> group_vertex_starts(position_count + 1, 0);
+    parallel_for(position_count, in_thread_count, [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t p = in_first; p < in_last; ++p)
+        {
+            uint32_t* begin = grouped_corners.data() + group_starts[p];
+            uint32_t* end = grouped_corners.data() + group_starts[p + 1];
+            std::sort(begin, end, [&](const uint32_t in_a, const uint32_t in_b)
+            {
+                const obj_corner& a = corner_at(in_a);
+                const obj_corner& b = corner_at(in_b);
+                return std::tie(a.normal, a.mapping, in_a) < std::tie(b.normal, b.mapping, in_b);
+            });
+            for (uint32_t* corner = begin; corner != end; ++corner)
+            {
+                group_vertex_starts[p + 1] += corner == begin || !(corner_at(*corner) == corner_at(corner[-1])) ? 1 : 0;
+            }
+        }
+    });
+    std::partial_sum(group_vertex_starts.begin(), group_vertex_starts.end(), group_vertex_starts.begin());
+
+    info.vertices.resize(group_vertex_starts.back());
+    parallel_for(position_count, in_thread_count, [&](const size_t in_first, const size_t in_last)
+    {
+        for (size_t p = in_first; p < in_last; ++p)
+        {
+            const uint32_t* begin = grouped_corners.data() + group_starts[p];
+            const uint32_t* end = grouped_corners.data() + group_starts[p + 1];
+            uint32_t next_vertex = group_vertex_starts[p];
+            uint32_t vertex = next_vertex;
+            for (const uint32_t* corner = begin; corner != end; ++corner)
+            {
+                if (corner == begin || !(corner_at(*corner) == corner_at(corner[-1])))
+                {
+                    vertex = next_vertex++;
+                    info.vertices[vertex] = vertex_of(attributes, normals, corner_at(*corner));
+                }
+                info.triangles[*corner / 3][*corner % 3] = vertex;
+            }
+        }
+    });
     return info;
 }
\ No newline at end of file
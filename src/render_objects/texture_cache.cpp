@@ -0,0 +1,165 @@
+#include <render_objects/texture_cache.hpp>
+
+#include <util/mapped_file.hpp>
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+// Increment whenever the texel formats, layouts or the file layout below change.
+static constexpr uint32_t texture_cache_version = 1;
+static constexpr std::array<char, 8> texture_cache_magic = { 'E', 'R', 'U', 'P', 'T', 'E', 'X', '\0' };
+static constexpr size_t texel_alignment = 64;
+
+// File layout: header, mip levels, source path, padding up to the texel alignment, texels.
+struct texture_cache_header
+{
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t level_count;
+    int64_t source_modified;
+    uint64_t source_size;
+    uint64_t content_hash;
+    extent_2D<uint32_t> size;
+    texel_format format;
+    texel_layout layout;
+    uint64_t path_length;
+    uint64_t texels_offset;
+    uint64_t texels_size;
+};
+
+source_stamp source_stamp::of(const std::filesystem::path& in_source_path)
+{
+    return source_stamp{
+        int64_t(std::filesystem::last_write_time(in_source_path).time_since_epoch().count()),
+        uint64_t(std::filesystem::file_size(in_source_path)),
+    };
+}
+
+static std::filesystem::path cache_file_path(const std::filesystem::path& in_cache_directory, const std::string& in_key)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (const char c : in_key)
+    {
+        hash = (hash ^ uint8_t(c)) * 1099511628211ull;
+    }
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".texture";
+    return in_cache_directory / name.str();
+}
+
+static std::string cache_key(const std::string_view in_source_path, const std::string_view in_kind)
+{
+    return std::string{ in_kind } + ':' + std::filesystem::absolute(in_source_path).string();
+}
+
+std::optional<cached_vector_map> load_cached_vector_map(const std::filesystem::path& in_cache_directory,
+    const std::string_view in_source_path, const std::string_view in_kind, const source_stamp& in_stamp)
+{
+    const std::string key = cache_key(in_source_path, in_kind);
+    const std::filesystem::path file_path = cache_file_path(in_cache_directory, key);
+    std::error_code error;
+    if (!std::filesystem::exists(file_path, error))
+    {
+        return std::nullopt;
+    }
+
+    std::shared_ptr<const mapped_file> file;
+    try
+    {
+        file = std::make_shared<const mapped_file>(file_path.string());
+    }
+    catch (const std::runtime_error&)
+    {
+        return std::nullopt;
+    }
+
+    texture_cache_header header;
+    if (file->size() < sizeof(header))
+    {
+        return std::nullopt;
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    const size_t levels_offset = sizeof(header);
+    const size_t path_offset = levels_offset + (size_t(header.level_count) * sizeof(mip_level));
+    if (header.magic != texture_cache_magic
+        || header.version != texture_cache_version
+        || header.source_modified != in_stamp.modified
+        || header.source_size != in_stamp.size
+        || header.path_length != key.size()
+        || header.texels_offset > file->size()
+        || header.texels_size > file->size() - header.texels_offset
+        || path_offset > header.texels_offset
+        || header.path_length > header.texels_offset - path_offset
+        || std::memcmp(file->data() + path_offset, key.data(), key.size()) != 0)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<mip_level> levels(header.level_count);
+    std::memcpy(levels.data(), file->data() + levels_offset, header.level_count * sizeof(mip_level));
+    const uint8_t* texels = file->data() + header.texels_offset;
+    vector_map map{ header.size, header.format, header.layout, byte_buffer(std::move(file), texels, header.texels_size), std::move(levels) };
+    if (!map.has_consistent_levels())
+    {
+        return std::nullopt;
+    }
+    return cached_vector_map{ std::move(map), header.content_hash };
+}
+
+void store_cached_vector_map(const std::filesystem::path& in_cache_directory,
+    const std::string_view in_source_path, const std::string_view in_kind, const source_stamp& in_stamp,
+    const vector_map& in_map, const uint64_t in_content_hash)
+{
+    const std::string key = cache_key(in_source_path, in_kind);
+    const size_t path_offset = sizeof(texture_cache_header) + (in_map.levels.size() * sizeof(mip_level));
+    const size_t texels_offset = (path_offset + key.size() + texel_alignment - 1) / texel_alignment * texel_alignment;
+    const texture_cache_header header = {
+        texture_cache_magic,
+        texture_cache_version,
+        uint32_t(in_map.levels.size()),
+        in_stamp.modified,
+        in_stamp.size,
+        in_content_hash,
+        in_map.size,
+        in_map.format,
+        in_map.layout,
+        key.size(),
+        texels_offset,
+        in_map.texels.size(),
+    };
+
+    // Written under a temporary name and renamed, so concurrent renders never map a partial file.
+    std::error_code error;
+    std::filesystem::create_directories(in_cache_directory, error);
+    const std::filesystem::path file_path = cache_file_path(in_cache_directory, key);
+    std::filesystem::path temporary_path = file_path;
+    temporary_path += "." + std::to_string(std::random_device{}()) + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary);
+        const std::vector<char> padding(texels_offset - path_offset - key.size(), 0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(in_map.levels.data()), in_map.levels.size() * sizeof(mip_level));
+        file.write(key.data(), key.size());
+        file.write(padding.data(), padding.size());
+        file.write(reinterpret_cast<const char*>(in_map.texels.data()), in_map.texels.size());
+        if (!file)
+        {
+            std::cerr << "Could not write texture cache file " << temporary_path << "." << std::endl;
+            std::filesystem::remove(temporary_path, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary_path, file_path, error);
+    if (error)
+    {
+        std::cerr << "Could not write texture cache file " << file_path << "." << std::endl;
+        std::filesystem::remove(temporary_path, error);
+    }
+}
\ No newline at end of file
@@ -2,10 +2,17 @@
 
 #include <render_objects/scene.hpp>
 #include <renderer_cpu/textures.hpp>
+#include <util/arena.hpp>
 
 #include <glm/gtx/optimum_pow.hpp>
 
-#include <stack>
+// Width of the ray cone at the hit in texture coordinates, stretched at grazing angles.
+static float mapping_footprint(const ray& in_ray, const float in_distance, const direction_3D& in_normal,
+    const float in_mapping_density)
+{
+    const float cosine = glm::abs(glm::dot(in_ray.direction, in_normal)) / glm::length(in_ray.direction);
+    return in_ray.cone.width_at(in_distance) * in_mapping_density / glm::max(cosine, 0.01f);
+}
 
 hit_record ray_hits(const plane_shape& in_plane, const ray& in_ray, const min_max<float>& in_distances)
 {
@@ -18,7 +25,9 @@ hit_record ray_hits(const plane_shape& in_plane, const ray& in_ray, const min_ma
             const position_3D hit_point = in_ray.point_at_distance(distance);
             const displacement_3D delta = hit_point - in_plane.origin;
             const barycentric_2D mapping = { glm::dot(delta, in_plane.right), glm::dot(delta, in_plane.up) };
-            return hit_record{ distance, hit_point, -glm::sign(dot) * plane_normal, {}, mapping };
+            const float mapping_density = glm::sqrt(glm::length(in_plane.right) * glm::length(in_plane.up));
+            return hit_record{ distance, hit_point, -glm::sign(dot) * plane_normal, {}, mapping,
+                mapping_footprint(in_ray, distance, plane_normal, mapping_density) };
         }
     }
     return hit_record::nope();
@@ -46,23 +55,28 @@ hit_record ray_hits(const sphere_shape& in_sphere, const ray& in_ray, const min_
             const position_3D hit_point = in_ray.point_at_distance(root);
             const direction_3D normal = (hit_point - in_sphere.origin) / in_sphere.radius;
             const barycentric_2D mapping = mapping_on_sphere(normal, in_sphere.axial_tilt);
-            return hit_record{ root, hit_point, normal, {}, mapping };
+            // Geometric mean of the 2 pi r and pi r spans of the mapping.
+            const float mapping_density = glm::one_over_pi<float>() / (glm::root_two<float>() * in_sphere.radius);
+            return hit_record{ root, hit_point, normal, {}, mapping,
+                mapping_footprint(in_ray, root, normal, mapping_density) };
         }
     }
     return hit_record::nope();
 }
 
-hit_record ray_hits(const triangle_shape& in_triangle, const ray& in_ray, const min_max<float>& in_distances)
+// Mller-Trumbore algorithm, the hit only holds the distance, the point and the barycentric coordinates
+// of the b and c corners in its mapping.
+static hit_record ray_hits_corners(const position_3D& in_a, const position_3D& in_b, const position_3D& in_c,
+    const ray& in_ray, const min_max<float>& in_distances)
 {
-    // Mller-Trumbore algorithm
-    const displacement_3D edge_1 = in_triangle.b - in_triangle.a;
-    const displacement_3D edge_2 = in_triangle.c - in_triangle.a;
+    const displacement_3D edge_1 = in_b - in_a;
+    const displacement_3D edge_2 = in_c - in_a;
     const displacement_3D p_vec = glm::cross(in_ray.direction, edge_2);
     const float determinant = glm::dot(edge_1, p_vec);
     if (glm::abs(determinant) > glm::epsilon<float>())
     {
         const float inverse_determinant = 1.f / determinant;
-        const displacement_3D t_vec = in_ray.origin - in_triangle.a;
+        const displacement_3D t_vec = in_ray.origin - in_a;
         const displacement_3D q_vec = glm::cross(t_vec, edge_1);
         const float U = glm::dot(t_vec, p_vec) * inverse_determinant;
         const float V = glm::dot(in_ray.direction, q_vec) * inverse_determinant;
@@ -70,44 +84,77 @@ hit_record ray_hits(const triangle_shape& in_triangle, const ray& in_ray, const
         {
             if (const float distance = glm::dot(q_vec, edge_2) * inverse_determinant; in_distances.is_value_clamped(distance))
             {
-                const position_3D hit_point = in_ray.point_at_distance(distance);
-                const direction_3D normal = ((1.f - U - V) * in_triangle.normal_a) + (U * in_triangle.normal_b) + (V * in_triangle.normal_c);
-                const barycentric_2D mapping = {
-                    ((1.f - U - V) * in_triangle.mapping_a.U) + (U * in_triangle.mapping_b.U) + (V * in_triangle.mapping_c.U),
-                    ((1.f - U - V) * in_triangle.mapping_a.V) + (U * in_triangle.mapping_b.V) + (V * in_triangle.mapping_c.V),
-                };
-                return hit_record{ distance, hit_point, normal, {}, mapping };
+                return hit_record{ distance, in_ray.point_at_distance(distance), displacement_3D{ 0.f },
+                    material{ material_type::none, 0 }, barycentric_2D{ U, V }, 0.f };
             }
         }
     }
     return hit_record::nope();
 }
 
-static hit_record ray_hits(const scene& in_scene, const shape& in_shape, const ray& in_ray, min_max<float>& in_distances)
+// Interpolates the corner attributes at the barycentric coordinates left in the mapping of the hit.
+static void interpolate_corners(const position_3D& in_a, const position_3D& in_b, const position_3D& in_c,
+    const std::array<direction_3D, 3>& in_normals, const std::array<barycentric_2D, 3>& in_mappings,
+    const ray& in_ray, hit_record& inout_hit)
 {
-    auto hit = hit_record::nope();
-    switch (in_shape.type)
-    {
-        case shape_type::plane:    hit = ray_hits(in_scene.plane_shapes[in_shape.index], in_ray, in_distances); break;
-        case shape_type::sphere:   hit = ray_hits(in_scene.sphere_shapes[in_shape.index], in_ray, in_distances); break;
-        case shape_type::triangle: hit = ray_hits(in_scene.triangle_shapes[in_shape.index], in_ray, in_distances); break;
-        default: return hit;
-    }
+    const float U = inout_hit.mapping.U;
+    const float V = inout_hit.mapping.V;
+    inout_hit.normal = ((1.f - U - V) * in_normals[0]) + (U * in_normals[1]) + (V * in_normals[2]);
+    inout_hit.mapping = {
+        ((1.f - U - V) * in_mappings[0].U) + (U * in_mappings[1].U) + (V * in_mappings[2].U),
+        ((1.f - U - V) * in_mappings[0].V) + (U * in_mappings[1].V) + (V * in_mappings[2].V),
+    };
+    const displacement_3D face = glm::cross(in_b - in_a, in_c - in_a);
+    const float face_area = glm::length(face);
+    const float mapping_area = glm::abs(
+        ((in_mappings[1].U - in_mappings[0].U) * (in_mappings[2].V - in_mappings[0].V)) -
+        ((in_mappings[2].U - in_mappings[0].U) * (in_mappings[1].V - in_mappings[0].V)));
+    const float mapping_density = glm::sqrt(mapping_area / face_area);
+    inout_hit.mapping_footprint = mapping_footprint(in_ray, inout_hit.distance, face / face_area, mapping_density);
+}
 
+hit_record ray_hits(const triangle_shape& in_triangle, const ray& in_ray, const min_max<float>& in_distances)
+{
+    hit_record hit = ray_hits_corners(in_triangle.a, in_triangle.b, in_triangle.c, in_ray, in_distances);
     if (hit.occurred)
     {
-        hit.mat = in_shape.mat;
-        if (is_valid_index(hit.mat.normals_index))
-        {
-            const normal_texture& normals = in_scene.normal_textures[hit.mat.normals_index];
-            hit.normal = map_normal(hit.normal, normal_on_texture(in_scene, normals, hit.mapping));
-        }
-
-        in_distances.max = hit.distance;
+        interpolate_corners(in_triangle.a, in_triangle.b, in_triangle.c,
+            { in_triangle.normal_a, in_triangle.normal_b, in_triangle.normal_c },
+            { in_triangle.mapping_a, in_triangle.mapping_b, in_triangle.mapping_c }, in_ray, hit);
     }
     return hit;
 }
 
+// Only the positions are read here, the other attributes are interpolated once the closest hit is known.
+static hit_record ray_hits(const scene& in_scene, const mesh_triangle_shape& in_triangle, const ray& in_ray,
+    const min_max<float>& in_distances)
+{
+    return ray_hits_corners(in_scene.mesh_positions[in_triangle.indices[0]], in_scene.mesh_positions[in_triangle.indices[1]],
+        in_scene.mesh_positions[in_triangle.indices[2]], in_ray, in_distances);
+}
+
+// Corners of a moving mesh triangle at a fraction of the motion interval.
+static std::array<position_3D, 3> corners_at(const scene& in_scene, const mesh_triangle_shape& in_triangle,
+    const float in_motion)
+{
+    std::array<position_3D, 3> corners;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        const uint32_t index = in_triangle.indices[i];
+        corners[i] = glm::mix(in_scene.mesh_positions[index], in_scene.mesh_end_positions[index], in_motion);
+    }
+    return corners;
+}
+
+// Planes of empty children are infinite at both ends of the motion and stay so.
+static BIH_clip clip_at(const BIH_clip& in_start, const BIH_clip& in_end, const float in_motion)
+{
+    return BIH_clip{
+        in_start.left == in_end.left ? in_start.left : glm::mix(in_start.left, in_end.left, in_motion),
+        in_start.right == in_end.right ? in_start.right : glm::mix(in_start.right, in_end.right, in_motion),
+    };
+}
+
 static auto ray_hits_children_of(const ray& in_ray, const BIH_node& in_node, const min_max<float>& in_distances)
 {
     const uint32_t axis = uint32_t(in_node.type);
@@ -139,68 +186,208 @@ static auto ray_hits_children_of(const ray& in_ray, const BIH_node& in_node, con
     return std::make_pair(hit_1, hit_2);
 }
 
+// Visits the leaves of a hierarchy the ray passes through, nearer ones first. The shapes in them are
+// tested against the distances, which shrink as closer hits are found.
+template <typename node_getter, typename leaf_visitor>
+static void traverse(const ray& in_ray, const min_max<float>& in_distances, const node_getter& in_node_at,
+    const leaf_visitor& in_visit_leaf)
+{
+    struct stack_entry { BIH_node node; min_max<float> distances; };
+    const arena_scope scratch_scope{ thread_scratch() };
+    scratch_stack<stack_entry> node_stack{ thread_scratch() };
+    node_stack.push({ in_node_at(0), in_distances });
+    while (!node_stack.empty())
+    {
+        stack_entry current_entry = node_stack.pop();
+        bool leaf_hit = true;
+        while (current_entry.node.type != BIH_node_type::leaf)
+        {
+            uint32_t node_1 = current_entry.node.children.left;
+            uint32_t node_2 = current_entry.node.children.right;
+            const auto [hit_1, hit_2] = ray_hits_children_of(in_ray, current_entry.node, current_entry.distances);
+            if (!hit_1.is_left_node)
+            {
+                std::swap(node_1, node_2);
+            }
+
+            if (hit_1.occurred)
+            {
+                current_entry = { in_node_at(node_1), hit_1.distances };
+                if (hit_2.occurred)
+                {
+                    node_stack.push({ in_node_at(node_2), hit_2.distances });
+                }
+            }
+            else if (hit_2.occurred)
+            {
+                current_entry = { in_node_at(node_2), hit_2.distances };
+            }
+            else
+            {
+                leaf_hit = false;
+                break;
+            }
+        }
+
+        if (leaf_hit)
+        {
+            in_visit_leaf(current_entry.node.shape_group.index, current_entry.node.shape_group.count);
+        }
+    }
+}
+
+static hit_record ray_hits(const scene& in_scene, const quantized_mesh& in_mesh,
+    const quantized_mesh_triangle_shape& in_triangle, const ray& in_ray, const min_max<float>& in_distances)
+{
+    return ray_hits_corners(in_mesh.unpack_position(in_scene.quantized_mesh_vertices[in_triangle.indices[0]]),
+        in_mesh.unpack_position(in_scene.quantized_mesh_vertices[in_triangle.indices[1]]),
+        in_mesh.unpack_position(in_scene.quantized_mesh_vertices[in_triangle.indices[2]]), in_ray, in_distances);
+}
+
+// The closest hit on the triangles of a quantized mesh, found through the mesh's own hierarchy.
+static hit_record ray_hits(const scene& in_scene, const quantized_mesh& in_mesh, const ray& in_ray,
+    min_max<float>& inout_distances, uint32_t& out_triangle)
+{
+    hit_record closest_hit = hit_record::nope();
+    const BIH_node* nodes = in_scene.quantized_mesh_hierarchies.data() + in_mesh.first_node;
+    const quantized_mesh_triangle_shape* triangles = in_scene.quantized_mesh_triangle_shapes.data() + in_mesh.first_triangle;
+    traverse(in_ray, inout_distances, [nodes](const uint32_t index) { return nodes[index]; },
+        [&](const uint32_t first, const uint32_t count)
+        {
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                if (const hit_record hit = ray_hits(in_scene, in_mesh, triangles[i], in_ray, inout_distances); hit.occurred)
+                {
+                    inout_distances.max = hit.distance;
+                    closest_hit = hit;
+                    out_triangle = in_mesh.first_triangle + i;
+                }
+            }
+        });
+    return closest_hit;
+}
+
+// Mesh shapes also give the triangle hit within them.
+static hit_record ray_hits(const scene& in_scene, const shape& in_shape, const ray& in_ray, min_max<float>& in_distances,
+    const float in_motion, uint32_t& out_triangle)
+{
+    auto hit = hit_record::nope();
+    switch (in_shape.type)
+    {
+        case shape_type::plane:                   hit = ray_hits(in_scene.plane_shapes[in_shape.index], in_ray, in_distances); break;
+        case shape_type::sphere:                  hit = ray_hits(in_scene.sphere_shapes[in_shape.index], in_ray, in_distances); break;
+        case shape_type::triangle:                hit = ray_hits(in_scene.triangle_shapes[in_shape.index], in_ray, in_distances); break;
+        case shape_type::mesh_triangle:           hit = ray_hits(in_scene, in_scene.mesh_triangle_shapes[in_shape.index], in_ray, in_distances); break;
+        case shape_type::quantized_mesh:          hit = ray_hits(in_scene, in_scene.quantized_meshes[in_shape.index], in_ray, in_distances, out_triangle); break;
+        case shape_type::moving_sphere:           hit = ray_hits(in_scene.moving_sphere_shapes[in_shape.index].at(in_motion), in_ray, in_distances); break;
+        case shape_type::moving_mesh_triangle:
+        {
+            const std::array<position_3D, 3> corners = corners_at(in_scene, in_scene.mesh_triangle_shapes[in_shape.index], in_motion);
+            hit = ray_hits_corners(corners[0], corners[1], corners[2], in_ray, in_distances);
+            break;
+        }
+        default: return hit;
+    }
+
+    if (hit.occurred)
+    {
+        in_distances.max = hit.distance;
+    }
+    return hit;
+}
+
+// Fills in what only the closest hit needs.
+static void complete_hit(const scene& in_scene, const shape& in_shape, const uint32_t in_triangle, const ray& in_ray,
+    const float in_motion, hit_record& inout_hit)
+{
+    if (in_shape.type == shape_type::mesh_triangle || in_shape.type == shape_type::moving_mesh_triangle)
+    {
+        const mesh_triangle_shape& triangle = in_scene.mesh_triangle_shapes[in_shape.index];
+        const std::array<uint32_t, 3>& indices = triangle.indices;
+        const std::array<position_3D, 3> corners = in_shape.type == shape_type::moving_mesh_triangle
+            ? corners_at(in_scene, triangle, in_motion)
+            : std::array<position_3D, 3>{ in_scene.mesh_positions[indices[0]], in_scene.mesh_positions[indices[1]],
+                in_scene.mesh_positions[indices[2]] };
+        interpolate_corners(corners[0], corners[1], corners[2],
+            { in_scene.mesh_normals[indices[0]], in_scene.mesh_normals[indices[1]], in_scene.mesh_normals[indices[2]] },
+            { in_scene.mesh_mappings[indices[0]], in_scene.mesh_mappings[indices[1]], in_scene.mesh_mappings[indices[2]] },
+            in_ray, inout_hit);
+    }
+    else if (in_shape.type == shape_type::quantized_mesh)
+    {
+        const quantized_mesh_triangle_shape& triangle = in_scene.quantized_mesh_triangle_shapes[in_triangle];
+        const quantized_mesh& mesh = in_scene.quantized_meshes[in_shape.index];
+        const quantized_vertex& a = in_scene.quantized_mesh_vertices[triangle.indices[0]];
+        const quantized_vertex& b = in_scene.quantized_mesh_vertices[triangle.indices[1]];
+        const quantized_vertex& c = in_scene.quantized_mesh_vertices[triangle.indices[2]];
+        interpolate_corners(mesh.unpack_position(a), mesh.unpack_position(b), mesh.unpack_position(c),
+            { a.unpack_normal(), b.unpack_normal(), c.unpack_normal() },
+            { a.unpack_mapping(), b.unpack_mapping(), c.unpack_mapping() },
+            in_ray, inout_hit);
+    }
+
+    inout_hit.mat = in_shape.mat;
+    if (is_valid_index(inout_hit.mat.normals_index))
+    {
+        const normal_texture& normals = in_scene.normal_textures[inout_hit.mat.normals_index];
+        inout_hit.normal = map_normal(inout_hit.normal, normal_on_texture(in_scene, normals, inout_hit.mapping, inout_hit.mapping_footprint));
+    }
+}
+
 hit_record ray_hits_anything(const scene& in_scene, const ray& in_ray)
 {
     hit_record closest_hit = hit_record::nope();
+    const shape* closest_shape = nullptr;
+    uint32_t closest_triangle = 0;
     min_max<float> distances = { 0.0001f, infinity<float> };
+    const float motion = in_scene.motion_at(in_ray.time);
 
-    for (const shape& it_shape : in_scene.infinite_shapes)
+    const auto test_shape = [&](const shape& in_shape)
     {
-        if (const hit_record hit = ray_hits(in_scene, it_shape, in_ray, distances); hit.occurred)
+        uint32_t triangle = 0;
+        if (const hit_record hit = ray_hits(in_scene, in_shape, in_ray, distances, motion, triangle); hit.occurred)
         {
             closest_hit = hit;
+            closest_shape = &in_shape;
+            closest_triangle = triangle;
         }
+    };
+
+    for (const shape& it_shape : in_scene.infinite_shapes)
+    {
+        test_shape(it_shape);
     }
 
-    if (!in_scene.hierarchy.empty())
+    lazy_BIH* const lazy_hierarchy = in_scene.lazy_hierarchy.get();
+    const BIH_clip* const end_clips = in_scene.hierarchy_end_clips.empty() ? nullptr : in_scene.hierarchy_end_clips.data();
+    const auto node_at = [&](const uint32_t index) -> BIH_node
     {
-        struct stack_entry { BIH_node node; min_max<float> distances; };
-        std::stack<stack_entry> node_stack;
-        node_stack.push({ in_scene.hierarchy.front(), distances });
-        while (!node_stack.empty())
+        if (lazy_hierarchy)
         {
-            stack_entry current_entry = node_stack.top();
-            node_stack.pop();
-            bool leaf_hit = true;
-            while (current_entry.node.type != BIH_node_type::leaf)
-            {
-                uint32_t node_1 = current_entry.node.children.left;
-                uint32_t node_2 = current_entry.node.children.right;
-                const auto [hit_1, hit_2] = ray_hits_children_of(in_ray, current_entry.node, current_entry.distances);
-                if (!hit_1.is_left_node)
-                {
-                    std::swap(node_1, node_2);
-                }
-
-                if (hit_1.occurred)
-                {
-                    current_entry = { in_scene.hierarchy[node_1], hit_1.distances };
-                    if (hit_2.occurred)
-                    {
-                        node_stack.push({ in_scene.hierarchy[node_2], hit_2.distances });
-                    }
-                }
-                else if (hit_2.occurred)
-                {
-                    current_entry = { in_scene.hierarchy[node_2], hit_2.distances };
-                }
-                else
-                {
-                    leaf_hit = false;
-                    break;
-                }
-            }
+            return lazy_hierarchy->node(index);
+        }
+        BIH_node node = in_scene.hierarchy[index];
+        if (end_clips && node.type != BIH_node_type::leaf)
+        {
+            node.clip = clip_at(node.clip, end_clips[index], motion);
+        }
+        return node;
+    };
 
-            if (leaf_hit) for (uint32_t i = 0; i < current_entry.node.shape_group.count; ++i)
+    if (lazy_hierarchy ? !lazy_hierarchy->empty() : !in_scene.hierarchy.empty())
+    {
+        traverse(in_ray, distances, node_at, [&](const uint32_t first, const uint32_t count)
+        {
+            for (uint32_t i = first; i < first + count; ++i)
             {
-                const shape& it_shape = in_scene.shapes[current_entry.node.shape_group.index + i];
-                if (const hit_record hit = ray_hits(in_scene, it_shape, in_ray, distances); hit.occurred)
-                {
-                    closest_hit = hit;
-                }
+                test_shape(in_scene.shapes[i]);
             }
-        }
+        });
     }
 
+    if (closest_shape)
+    {
+        complete_hit(in_scene, *closest_shape, closest_triangle, in_ray, motion, closest_hit);
+    }
     return closest_hit;
 }
\ No newline at end of file
@@ -17,17 +17,19 @@ ray::ray()
     : line(line{ position_3D{ 0.f }, direction_3D{ 0.f } })
     , inverse_direction(0.f)
     , time(0.f)
+    , cone()
 {
 }
 
-ray::ray(const line& in_line, const float in_time)
+ray::ray(const line& in_line, const float in_time, const ray_cone& in_cone)
     : line(in_line)
     , inverse_direction(1.f / in_line.direction)
     , time(in_time)
+    , cone(in_cone)
 {
 }
 
-ray ray::shoot(const camera& in_camera, const barycentric_2D& in_screen_UV)
+ray ray::shoot(const camera& in_camera, const barycentric_2D& in_screen_UV, const float in_pixel_spread)
 {
     const displacement_3D random_spot_on_lens = in_camera.lens_radius * random_in_unit_disk();
     const displacement_3D offset = (in_camera.u * random_spot_on_lens.x) + (in_camera.v * random_spot_on_lens.y);
@@ -39,6 +41,7 @@ ray ray::shoot(const camera& in_camera, const barycentric_2D& in_screen_UV)
                 + (in_screen_UV.V * in_camera.vertical) - origin),
         },
         random_uniform(in_camera.time.min, in_camera.time.max),
+        ray_cone{ 0.f, in_pixel_spread },
     };
 }
 
@@ -69,5 +72,7 @@ color ray::trace(const scene& in_scene, const int32_t depth) const
         }
     }
     const direction_3D unit_direction = glm::normalize(this->direction);
-    return color_on_texture(in_scene, in_scene.sky, mapping_on_sphere(unit_direction, y_axis), this->origin + this->direction);
+    const float sky_footprint = this->cone.spread * glm::one_over_pi<float>();
+    return color_on_texture(in_scene, in_scene.sky, mapping_on_sphere(unit_direction, y_axis),
+        this->origin + this->direction, sky_footprint);
 }
\ No newline at end of file
@@ -1,10 +1,13 @@
 #include <renderer_cpu/renderer_cpu.hpp>
 
+#include <output/image_writer.hpp>
 #include <render_objects/render_plan.hpp>
 #include <renderer_cpu/ray.hpp>
+#include <util/arena.hpp>
 #include <util/random.hpp>
 #include <util/vector.hpp>
 
+#include <array>
 #include <iomanip>
 #include <iostream>
 
@@ -60,6 +63,284 @@ std::vector<rgba> renderer_cpu::render_scene(const render_plan& in_plan) const
     return pixels;
 }
 
+void renderer_cpu::render_sequence(render_plan& in_plan, const frame_sink& in_sink) const
+{
+    if (in_plan.anim.is_empty())
+    {
+        throw std::runtime_error("Render plan has no animation to render.");
+    }
+
+    std::future<void> previous_frame_output;
+    for (uint32_t i = 0; i < in_plan.anim.frame_count; ++i)
+    {
+        const animation_frame frame = in_plan.anim.frame(i);
+        std::cout << "Frame " << (i + 1) << "/" << in_plan.anim.frame_count << std::endl;
+
+        camera_create_info camera_info = in_plan.anim.animate_camera(frame);
+        camera_info.time = frame.time;
+        in_plan.cam = camera{ camera_info };
+
+        if (in_plan.anim.animate_scene &&
+            in_plan.anim.animate_scene(in_plan.world, frame) == scene_changes::geometry)
+        {
+            in_plan.world.update_hierarchy();
+        }
+
+        std::vector<rgba> pixels = this->render_scene(in_plan);
+
+        // Outputting the previous frame overlaps with updating and rendering this one.
+        // Waiting for it only now keeps at most two finished frames in memory, this one and the one
+        // being output.
+        if (previous_frame_output.valid())
+        {
+            previous_frame_output.get();
+        }
+        previous_frame_output = std::async(std::launch::async,
+            [&in_sink, frame, frame_pixels = std::move(pixels)]() mutable {
+                in_sink(std::move(frame_pixels), frame);
+            });
+    }
+
+    if (previous_frame_output.valid())
+    {
+        previous_frame_output.get();
+    }
+}
+
+budgeted_render renderer_cpu::render_scene_within(const render_plan& in_plan,
+    const std::chrono::milliseconds in_time_budget) const
+{
+    std::cout << "Rendering image passes for " << in_time_budget.count() << " ms... 0";
+
+    const auto deadline = std::chrono::steady_clock::now() + in_time_budget;
+    const auto is_past_deadline = [deadline]() { return std::chrono::steady_clock::now() >= deadline; };
+
+    const size_t pixel_count = in_plan.image_size.width * in_plan.image_size.height;
+    std::vector<color> colors(pixel_count, color{ 0.f });
+    std::vector<uint32_t> sample_counts(pixel_count, 0);
+
+    // One sample per pass keeps the sample counts of any two pixels at most one apart.
+    uint32_t pass_count = 0;
+    while (this->render_pass(in_plan, render_pass_info{}, is_past_deadline, colors, sample_counts))
+    {
+        ++pass_count;
+
+        std::lock_guard lock{ this->progress_mtx };
+        std::cout << "\rRendering image passes for " << in_time_budget.count() << " ms... " << pass_count;
+    }
+
+    budgeted_render result{ std::vector<rgba>(pixel_count), std::move(sample_counts),
+        { ~uint32_t(0), 0 }, 0.f, pass_count };
+    uint64_t total_sample_count = 0;
+    for (size_t p = 0; p < pixel_count; ++p)
+    {
+        const uint32_t pixel_sample_count = result.sample_counts[p];
+        const color pixel_color = pixel_sample_count > 0 ? glm::sqrt(colors[p] / float(pixel_sample_count)) : black;
+        result.pixels[p] = rgba{ to_rgb(pixel_color), 255 };
+
+        result.sample_count_range.min = std::min(result.sample_count_range.min, pixel_sample_count);
+        result.sample_count_range.max = std::max(result.sample_count_range.max, pixel_sample_count);
+        total_sample_count += pixel_sample_count;
+    }
+    result.average_sample_count = float(total_sample_count) / float(std::max<size_t>(pixel_count, 1));
+
+    std::cout << "\rRendering image passes for " << in_time_budget.count() << " ms... Done. "
+        << "Samples per pixel: " << result.sample_count_range.min << "-" << result.sample_count_range.max
+        << " (" << std::fixed << std::setprecision(2) << result.average_sample_count << " on average)." << std::endl;
+    return result;
+}
+
+bool renderer_cpu::render_preview(const render_plan& in_plan, const std::atomic<bool>& in_cancelled,
+    const preview_sink& in_sink) const
+{
+    constexpr uint32_t coarsest_pixel_stride = 8;
+    constexpr int32_t coarse_depth = 4;
+
+    const size_t pixel_count = in_plan.image_size.width * in_plan.image_size.height;
+    const auto is_cancelled = [&in_cancelled]() { return in_cancelled.load(); };
+
+    std::vector<color> colors(pixel_count);
+    std::vector<uint32_t> sample_counts(pixel_count);
+    std::vector<rgba> pixels(pixel_count);
+
+    // Coarse stages put a single sample in the top-left pixel of each block, which stands for the whole block.
+    const auto publish = [&](const render_pass_info& in_pass)
+    {
+        const uint32_t stride = in_pass.pixel_stride;
+        for (uint32_t y = 0; y < in_plan.image_size.height; ++y)
+        {
+            for (uint32_t x = 0; x < in_plan.image_size.width; ++x)
+            {
+                const size_t block = (x - (x % stride)) + (size_t(y - (y % stride)) * in_plan.image_size.width);
+                const uint32_t block_sample_count = sample_counts[block];
+                const color pixel_color = block_sample_count > 0
+                    ? glm::sqrt(colors[block] / float(block_sample_count))
+                    : black;
+                pixels[x + (size_t(y) * in_plan.image_size.width)] = rgba{ to_rgb(pixel_color), 255 };
+            }
+        }
+        in_sink(pixels, preview_update{ stride, in_pass.depth, sample_counts.front() });
+    };
+
+    for (uint32_t stride = coarsest_pixel_stride; stride > 1; stride /= 2)
+    {
+        std::fill(colors.begin(), colors.end(), color{ 0.f });
+        std::fill(sample_counts.begin(), sample_counts.end(), 0);
+        const render_pass_info pass{ 1, stride, coarse_depth };
+        if (!this->render_pass(in_plan, pass, is_cancelled, colors, sample_counts))
+        {
+            return false;
+        }
+        publish(pass);
+    }
+
+    // Coarse samples are too shallow to keep, so full resolution starts over.
+    std::fill(colors.begin(), colors.end(), color{ 0.f });
+    std::fill(sample_counts.begin(), sample_counts.end(), 0);
+    for (uint32_t s = 0; s < this->sample_count; ++s)
+    {
+        const render_pass_info pass{};
+        if (!this->render_pass(in_plan, pass, is_cancelled, colors, sample_counts))
+        {
+            return false;
+        }
+        publish(pass);
+    }
+    return true;
+}
+
+bool renderer_cpu::render_pass(const render_plan& in_plan, const render_pass_info& in_pass,
+    const std::function<bool()>& in_should_stop, std::vector<color>& inout_colors,
+    std::vector<uint32_t>& inout_sample_counts) const
+{
+    const extent_2D<float> inverse_image_size = {
+        1.f / in_plan.image_size.width,
+        1.f / in_plan.image_size.height,
+    };
+    const uint32_t stride = in_pass.pixel_stride;
+    const uint32_t row_count = (in_plan.image_size.height + stride - 1) / stride;
+
+    std::atomic<uint32_t> next_row = 0;
+    std::atomic<bool> stopped = false;
+    {
+        std::vector<std::future<void>> jobs;
+        jobs.reserve(this->thread_count);
+        for (size_t i = 0; i < this->thread_count; ++i)
+        {
+            jobs.emplace_back(std::async(std::launch::async, [&]() {
+                for (uint32_t r = next_row++; r < row_count; r = next_row++)
+                {
+                    if (stopped || in_should_stop())
+                    {
+                        stopped = true;
+                        return;
+                    }
+
+                    thread_scratch().reset();
+                    const uint32_t y = r * stride;
+                    const uint32_t sampled_y = std::min(y + (stride / 2), in_plan.image_size.height - 1);
+                    for (uint32_t x = 0; x < in_plan.image_size.width; x += stride)
+                    {
+                        const uint32_t sampled_x = std::min(x + (stride / 2), in_plan.image_size.width - 1);
+                        const size_t p = x + (size_t(y) * in_plan.image_size.width);
+                        for (uint32_t s = 0; s < in_pass.samples_per_pixel; ++s)
+                        {
+                            inout_colors[p] += this->sample_pixel(in_plan, pixel_position{ sampled_x, sampled_y },
+                                inverse_image_size, in_pass.depth);
+                        }
+                        inout_sample_counts[p] += in_pass.samples_per_pixel;
+                    }
+                }
+            }));
+        }
+    }
+    return !stopped;
+}
+
+void renderer_cpu::render_scene_to_file(const render_plan& in_plan, const std::string_view in_path,
+    const uint32_t in_band_height) const
+{
+    using namespace std::string_literals;
+    if (image_format_of(in_path) == image_format::jpg)
+    {
+        throw std::runtime_error("JPEG images cannot be written in bands: "s + std::string{ in_path });
+    }
+    if (in_plan.image_size.width == 0 || in_plan.image_size.height == 0)
+    {
+        throw std::runtime_error("Cannot render an empty image: "s + std::string{ in_path });
+    }
+
+    std::cout << "Rendering image bands... 0.00%";
+
+    const uint32_t image_height = in_plan.image_size.height;
+    const uint32_t band_height = glm::clamp<uint32_t>(in_band_height, 1, image_height);
+    const size_t band_pixel_count = size_t(band_height) * in_plan.image_size.width;
+
+    // One band is being written out while the next one renders.
+    std::array<std::vector<rgba>, 2> bands = {
+        std::vector<rgba>(band_pixel_count),
+        std::vector<rgba>(band_pixel_count),
+    };
+    image_writer writer{ in_path, in_plan.image_size, this->thread_count };
+    std::future<void> band_output;
+
+    for (uint32_t first_row = 0, b = 0; first_row < image_height; first_row += band_height, ++b)
+    {
+        const uint32_t row_count = std::min(band_height, image_height - first_row);
+        std::vector<rgba>& band = bands[b % 2];
+        this->render_rows(in_plan, first_row, row_count, band.data());
+
+        if (band_output.valid())
+        {
+            band_output.get();
+        }
+        band_output = std::async(std::launch::async, [&writer, &band, row_count]() {
+            writer.write_rows(band.data(), row_count);
+        });
+
+        std::lock_guard lock{ this->progress_mtx };
+        std::cout
+            << "\rRendering image bands... "
+            << std::fixed << std::setprecision(2)
+            << 100.f * float(first_row + row_count) / float(image_height) << "%";
+    }
+
+    if (band_output.valid())
+    {
+        band_output.get();
+    }
+    writer.finish();
+
+    std::cout << "\rRendering image bands... Done.  " << std::endl;
+}
+
+void renderer_cpu::render_rows(const render_plan& in_plan, const uint32_t in_first_row, const uint32_t in_row_count,
+    rgba* out_pixels) const
+{
+    const extent_2D<float> inverse_image_size = {
+        1.f / in_plan.image_size.width,
+        1.f / in_plan.image_size.height,
+    };
+
+    std::atomic<uint32_t> next_row = 0;
+    std::vector<std::future<void>> jobs;
+    jobs.reserve(this->thread_count);
+    for (size_t i = 0; i < this->thread_count; ++i)
+    {
+        jobs.emplace_back(std::async(std::launch::async, [&]() {
+            for (uint32_t r = next_row++; r < in_row_count; r = next_row++)
+            {
+                for (uint32_t x = 0; x < in_plan.image_size.width; ++x)
+                {
+                    const pixel_position pixel = { x, in_first_row + r };
+                    const color pixel_color = this->render_pixel(in_plan, pixel, inverse_image_size);
+                    out_pixels[x + (size_t(r) * in_plan.image_size.width)] = rgba{ to_rgb(pixel_color), 255 };
+                }
+            }
+        }));
+    }
+}
+
 color renderer_cpu::render_single_pixel(const render_plan& in_plan, const pixel_position& in_position) const
 {
     return this->render_pixel(in_plan, in_position, { 1.f / in_plan.image_size.width, 1.f / in_plan.image_size.height });
@@ -68,15 +349,23 @@ color renderer_cpu::render_single_pixel(const render_plan& in_plan, const pixel_
 color renderer_cpu::render_pixel(const render_plan& in_plan, const pixel_position& in_position,
     const extent_2D<float>& in_inverse_size) const
 {
+    thread_scratch().reset();
     color col{ 0.f };
     for (uint32_t s = 0; s < sample_count; ++s)
     {
-        const barycentric_2D ray_direction = {
-            (in_position.x + random_uniform<float>()) * in_inverse_size.width,
-            (in_plan.image_size.height - in_position.y + random_uniform<float>()) * in_inverse_size.height,
-        };
-        col += remove_NaNs(ray::shoot(in_plan.cam, ray_direction).trace(in_plan.world));
+        col += this->sample_pixel(in_plan, in_position, in_inverse_size);
     }
     col *= this->inverse_sample_count;
     return glm::sqrt(col);
+}
+
+color renderer_cpu::sample_pixel(const render_plan& in_plan, const pixel_position& in_position,
+    const extent_2D<float>& in_inverse_size, const int32_t in_depth) const
+{
+    const barycentric_2D ray_direction = {
+        (in_position.x + random_uniform<float>()) * in_inverse_size.width,
+        (in_plan.image_size.height - in_position.y + random_uniform<float>()) * in_inverse_size.height,
+    };
+    const float pixel_spread = in_plan.cam.vertical_fov * in_inverse_size.height;
+    return remove_NaNs(ray::shoot(in_plan.cam, ray_direction, pixel_spread).trace(in_plan.world, in_depth));
 }
\ No newline at end of file
@@ -8,6 +8,9 @@
 
 #include <glm/glm.hpp>
 
+// Diffuse bounces gather light from the whole hemisphere, so what they hit is seen very blurred.
+static constexpr float diffuse_cone_spread = 0.2f;
+
 static float Schlick(const float in_cosine, const float in_refractive_index)
 {
     const float r0 = glm::pow((1 - in_refractive_index) / (1 + in_refractive_index), 2);
@@ -29,20 +32,21 @@ static scatter_record scatter(const scene& in_scene, const dielectric_material&
         ? Schlick(cosine, in_dielectric.refractive_index)
         : 1.f;
 
-    const color col = color_on_texture(in_scene, in_dielectric.albedo, in_hit.mapping, in_hit.point);
+    const color col = color_on_texture(in_scene, in_dielectric.albedo, in_hit.mapping, in_hit.point, in_hit.mapping_footprint);
     if (random_chance(reflect_probability))
     {
         const displacement_3D reflected = glm::reflect(in_ray.direction, in_hit.normal);
-        return scatter_record{ col, ray{ line{ in_hit.point, reflected }, in_ray.time } };
+        return scatter_record{ col, ray{ line{ in_hit.point, reflected }, in_ray.time, in_ray.cone.at_distance(in_hit.distance) } };
     }
-    return scatter_record{ col, ray{ line{ in_hit.point, refracted }, in_ray.time }, false };
+    return scatter_record{ col, ray{ line{ in_hit.point, refracted }, in_ray.time, in_ray.cone.at_distance(in_hit.distance) }, false };
 }
 
 static scatter_record scatter(const scene& in_scene, const diffuse_material& in_diffuse, const ray& in_ray, const hit_record& in_hit)
 {
     const direction_3D direction = glm::normalize(ortho_normal_base{ in_hit.normal }.local(random_cosine_direction()));
-    const ray scattered_ray{ line{ in_hit.point, direction }, in_ray.time };
-    const color albedo = color_on_texture(in_scene, in_diffuse.albedo, in_hit.mapping, in_hit.point);
+    const ray scattered_ray{ line{ in_hit.point, direction }, in_ray.time,
+        in_ray.cone.at_distance(in_hit.distance, diffuse_cone_spread) };
+    const color albedo = color_on_texture(in_scene, in_diffuse.albedo, in_hit.mapping, in_hit.point, in_hit.mapping_footprint);
 
     const float cosine = glm::dot(in_hit.normal, scattered_ray.direction);
     const float scattering_PDF = float(cosine >= 0) * cosine * glm::one_over_pi<float>();
@@ -59,10 +63,11 @@ static scatter_record scatter(const scene& in_scene, const emit_light_material&
 static scatter_record scatter(const scene& in_scene, const reflect_material& in_reflect, const ray& in_ray, const hit_record& in_hit)
 {
     const displacement_3D reflected = glm::reflect(in_ray.direction, in_hit.normal);
-    const ray scattered = { line{ in_hit.point, reflected + (in_reflect.fuzz * random_in_unit_sphere()) }, in_ray.time };
+    const ray scattered = { line{ in_hit.point, reflected + (in_reflect.fuzz * random_in_unit_sphere()) }, in_ray.time,
+        in_ray.cone.at_distance(in_hit.distance, in_reflect.fuzz) };
     if (glm::dot(scattered.direction, in_hit.normal) > 0.f)
     {
-        return scatter_record{ color_on_texture(in_scene, in_reflect.albedo, in_hit.mapping, in_hit.point), scattered, true };
+        return scatter_record{ color_on_texture(in_scene, in_reflect.albedo, in_hit.mapping, in_hit.point, in_hit.mapping_footprint), scattered, true };
     }
     return scatter_record::nope();
 }
@@ -4,7 +4,9 @@
 #include <render_objects/textures.hpp>
 #include <util/barycentric.hpp>
 #include <util/interpolation.hpp>
+#include <util/noise.hpp>
 #include <util/numeric.hpp>
+#include <util/random.hpp>
 #include <util/vector.hpp>
 
 static color color_on_texture(const checker_texture& in_checker_texture, const barycentric_2D& in_mapping)
@@ -22,51 +24,73 @@ static color color_on_texture(const constant_texture& in_constant_texture)
     return in_constant_texture.value;
 }
 
-static glm::vec3 value_on_vector_map(const vector_map& in_map, const barycentric_2D& in_mapping,
-    const min_max<texture_position_2D>& in_map_fragment, const wrap_method in_wrap_method,
-    const filtering_method in_filtering_method)
+// Picks one of the two closest levels at random, weighted by the distance to each, which averages
+// out to trilinear filtering over many samples.
+static uint32_t level_of_detail(const vector_map& in_map, const min_max<texture_position_2D>& in_map_fragment,
+    const float in_footprint)
 {
-    switch (in_filtering_method)
+    const float fragment_width = in_map_fragment.max.s - in_map_fragment.min.s;
+    const float fragment_height = in_map_fragment.max.t - in_map_fragment.min.t;
+    const float texel_footprint = in_footprint * glm::max(fragment_width, fragment_height);
+    if (texel_footprint <= 1.f)
     {
-        case filtering_method::catrom:  return filter_catrom(in_map, in_map_fragment, in_mapping, in_wrap_method);
-        case filtering_method::linear:  return filter_linear(in_map, in_map_fragment, in_mapping, in_wrap_method);
-        case filtering_method::nearest: return filter_nearest(in_map, in_map_fragment, in_mapping, in_wrap_method);
+        return 0;
     }
+
+    const uint32_t max_level = std::min<uint32_t>(in_map.levels.size() - 1, last_level_of_fragment(in_map_fragment));
+
+    float level;
+    const float level_fract = glm::modf(glm::log2(texel_footprint), level);
+    return std::min(max_level, uint32_t(level) + uint32_t(random_chance(level_fract)));
+}
+
+static glm::vec3 value_on_vector_map(const vector_map& in_map, const barycentric_2D& in_mapping, const float in_footprint,
+    const min_max<texture_position_2D>& in_map_fragment, const uint32_t in_sampler)
+{
+    const uint32_t level = level_of_detail(in_map, in_map_fragment, in_footprint);
+    return sampler_at(in_sampler, in_map)(in_map, level, in_map_fragment, in_mapping);
 }
 
-static color color_on_texture(const scene& in_scene, const image_texture& in_image_texture, const barycentric_2D& in_mapping)
+static color color_on_texture(const scene& in_scene, const image_texture& in_image_texture, const barycentric_2D& in_mapping,
+    const float in_footprint)
 {
     return value_on_vector_map(
         in_scene.images[in_image_texture.image_index],
         in_mapping,
+        in_footprint,
         in_image_texture.image_fragment,
-        in_image_texture.wrap,
-        in_image_texture.filtering);
+        in_image_texture.sampler);
 }
 
+// Marble veins: a sine wave along z, displaced by turbulence.
 static color color_on_texture(const noise_texture& in_noise_texture, const barycentric_2D& in_mapping, const position_3D& in_position)
 {
-    return white;
+    static const perlin noise;
+    const position_3D p = in_noise_texture.scale * in_position;
+    const float t = 0.5f * (1.f + glm::sin(p.z + (10.f * turbulence(noise, p))));
+    return glm::mix(in_noise_texture.color_2, in_noise_texture.color_1, t);
 }
 
-color color_on_texture(const scene& in_scene, const texture& in_texture, const barycentric_2D& in_mapping, const position_3D& in_position)
+color color_on_texture(const scene& in_scene, const texture& in_texture, const barycentric_2D& in_mapping, const position_3D& in_position,
+    const float in_footprint)
 {
     switch (in_texture.type)
     {
         case texture_type::checker:  return color_on_texture(in_scene.checker_textures[in_texture.index], in_mapping);
         case texture_type::constant: return color_on_texture(in_scene.constant_textures[in_texture.index]);
-        case texture_type::image:    return color_on_texture(in_scene, in_scene.image_textures[in_texture.index], in_mapping);
+        case texture_type::image:    return color_on_texture(in_scene, in_scene.image_textures[in_texture.index], in_mapping, in_footprint);
         case texture_type::noise:    return color_on_texture(in_scene.noise_textures[in_texture.index], in_mapping, in_position);
         default: return black;
     }
 }
 
-direction_3D normal_on_texture(const scene& in_scene, const normal_texture& in_normal_texture, const barycentric_2D& in_mapping)
+direction_3D normal_on_texture(const scene& in_scene, const normal_texture& in_normal_texture, const barycentric_2D& in_mapping,
+    const float in_footprint)
 {
     return value_on_vector_map(
         in_scene.normal_maps[in_normal_texture.map_index],
         in_mapping,
+        in_footprint,
         in_normal_texture.map_fragment,
-        in_normal_texture.wrap,
-        in_normal_texture.filtering);
+        in_normal_texture.sampler);
 }
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include <util/aligned_allocator.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+static constexpr size_t cache_line_size = 64;
+static constexpr size_t huge_page_size = size_t(2) << 20;
+
+static size_t alignment_for(const size_t in_size)
+{
+    return in_size >= huge_page_size ? huge_page_size : cache_line_size;
+}
+
+static size_t round_up(const size_t in_size, const size_t in_alignment)
+{
+    return (in_size + in_alignment - 1) & ~(in_alignment - 1);
+}
+
+#if defined(_WIN32)
+
+// Large pages need a privilege most users do not have, so only the alignment applies.
+void* allocate_aligned_bytes(const size_t in_size)
+{
+    void* bytes = _aligned_malloc(round_up(std::max<size_t>(in_size, 1), cache_line_size), alignment_for(in_size));
+    if (!bytes)
+    {
+        throw std::bad_alloc();
+    }
+    return bytes;
+}
+
+void free_aligned_bytes(void* in_bytes, const size_t)
+{
+    _aligned_free(in_bytes);
+}
+
+#else
+
+void* allocate_aligned_bytes(const size_t in_size)
+{
+    const size_t alignment = alignment_for(in_size);
+    const size_t size = round_up(std::max<size_t>(in_size, 1), alignment);
+    void* bytes = std::aligned_alloc(alignment, size);
+    if (!bytes)
+    {
+        throw std::bad_alloc();
+    }
+#if defined(MADV_HUGEPAGE)
+    if (alignment == huge_page_size)
+    {
+        madvise(bytes, size, MADV_HUGEPAGE);
+    }
+#endif
+    return bytes;
+}
+
+void free_aligned_bytes(void* in_bytes, const size_t)
+{
+    std::free(in_bytes);
+}
+
+#endif
\ No newline at end of file
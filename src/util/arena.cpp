@@ -0,0 +1,51 @@
+#include <util/arena.hpp>
+
+#include <algorithm>
+
+monotonic_arena::monotonic_arena(const size_t in_block_size)
+    : block_size(in_block_size)
+{
+}
+
+void* monotonic_arena::allocate(const size_t in_size, const size_t in_alignment)
+{
+    for (; this->current_block < this->blocks.size(); ++this->current_block, this->current_offset = 0)
+    {
+        const block& current = this->blocks[this->current_block];
+        const uintptr_t start = reinterpret_cast<uintptr_t>(current.bytes.get());
+        const uintptr_t aligned = (start + this->current_offset + in_alignment - 1) & ~uintptr_t(in_alignment - 1);
+        if (aligned + in_size <= start + current.size)
+        {
+            this->current_offset = (aligned - start) + in_size;
+            return reinterpret_cast<void*>(aligned);
+        }
+    }
+
+    const size_t size = std::max(this->block_size, in_size + in_alignment);
+    this->blocks.push_back(block{ std::make_unique<uint8_t[]>(size), size });
+    this->current_block = this->blocks.size() - 1;
+    this->current_offset = 0;
+    return this->allocate(in_size, in_alignment);
+}
+
+void monotonic_arena::rewind(const marker& in_marker)
+{
+    this->current_block = in_marker.block;
+    this->current_offset = in_marker.offset;
+}
+
+size_t monotonic_arena::capacity() const
+{
+    size_t capacity = 0;
+    for (const block& it_block : this->blocks)
+    {
+        capacity += it_block.size;
+    }
+    return capacity;
+}
+
+monotonic_arena& thread_scratch()
+{
+    thread_local monotonic_arena arena{ size_t(64) << 10 };
+    return arena;
+}
\ No newline at end of file
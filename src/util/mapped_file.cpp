@@ -0,0 +1,94 @@
+#include <util/mapped_file.hpp>
+
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+mapped_file::mapped_file(const std::string& in_path)
+    : file_path(in_path)
+{
+    using namespace std::literals;
+    this->file_handle = CreateFileA(in_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (this->file_handle == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error("File '"s + in_path + "' could not be opened.");
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(this->file_handle, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(this->file_handle);
+        throw std::runtime_error("File '"s + in_path + "' is empty.");
+    }
+
+    this->mapping_handle = CreateFileMappingA(this->file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!this->mapping_handle)
+    {
+        CloseHandle(this->file_handle);
+        throw std::runtime_error("File '"s + in_path + "' could not be mapped.");
+    }
+
+    this->bytes = static_cast<const uint8_t*>(MapViewOfFile(this->mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (!this->bytes)
+    {
+        CloseHandle(this->mapping_handle);
+        CloseHandle(this->file_handle);
+        throw std::runtime_error("File '"s + in_path + "' could not be mapped.");
+    }
+    this->byte_count = size_t(file_size.QuadPart);
+}
+
+mapped_file::~mapped_file()
+{
+    UnmapViewOfFile(this->bytes);
+    CloseHandle(this->mapping_handle);
+    CloseHandle(this->file_handle);
+}
+
+#else
+
+mapped_file::mapped_file(const std::string& in_path)
+    : file_path(in_path)
+{
+    using namespace std::literals;
+    const int file = open(in_path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        throw std::runtime_error("File '"s + in_path + "' could not be opened.");
+    }
+
+    struct stat file_status;
+    if (fstat(file, &file_status) != 0 || file_status.st_size == 0)
+    {
+        close(file);
+        throw std::runtime_error("File '"s + in_path + "' is empty.");
+    }
+
+    void* mapping = mmap(nullptr, size_t(file_status.st_size), PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("File '"s + in_path + "' could not be mapped.");
+    }
+    this->bytes = static_cast<const uint8_t*>(mapping);
+    this->byte_count = size_t(file_status.st_size);
+}
+
+mapped_file::~mapped_file()
+{
+    munmap(const_cast<uint8_t*>(this->bytes), this->byte_count);
+}
+
+#endif
\ No newline at end of file
@@ -6,6 +6,13 @@
 #include <algorithm>
 #include <numeric>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE 1
+#include <emmintrin.h>
+#else
+#define USE_SSE 0
+#endif
+
 perlin::perlin()
 {
     std::generate(this->random_vectors.begin(), this->random_vectors.end(), [] {
@@ -45,4 +52,107 @@ float perlin::noise(const glm::vec3& p) const
             this->z_permutations[(k + dk) & 255]];
     }
     return perlin_trilerp(c, u, v, w);
-}
\ No newline at end of file
+}
+
+#if USE_SSE
+
+static __m128 floor_4(const __m128 in_values)
+{
+    const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(in_values));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, in_values), _mm_set1_ps(1.f)));
+}
+
+static __m128 smoothstep_4(const __m128 in_t)
+{
+    return _mm_mul_ps(_mm_mul_ps(in_t, in_t), _mm_sub_ps(_mm_set1_ps(3.f), _mm_add_ps(in_t, in_t)));
+}
+
+// The same trilinear blend of gradients as perlin_trilerp, with the four points in separate lanes.
+void perlin::noise(const glm::vec3* in_points, const size_t in_count, float* out_values) const
+{
+    for (size_t first = 0; first < in_count; first += 4)
+    {
+        const size_t lane_count = std::min<size_t>(4, in_count - first);
+        alignas(16) float xs[4] = {}, ys[4] = {}, zs[4] = {};
+        for (size_t l = 0; l < lane_count; ++l)
+        {
+            xs[l] = in_points[first + l].x;
+            ys[l] = in_points[first + l].y;
+            zs[l] = in_points[first + l].z;
+        }
+
+        const __m128 x = _mm_load_ps(xs);
+        const __m128 y = _mm_load_ps(ys);
+        const __m128 z = _mm_load_ps(zs);
+        const __m128 x_floor = floor_4(x);
+        const __m128 y_floor = floor_4(y);
+        const __m128 z_floor = floor_4(z);
+        const __m128 u = _mm_sub_ps(x, x_floor);
+        const __m128 v = _mm_sub_ps(y, y_floor);
+        const __m128 w = _mm_sub_ps(z, z_floor);
+        const __m128 uu = smoothstep_4(u);
+        const __m128 vv = smoothstep_4(v);
+        const __m128 ww = smoothstep_4(w);
+
+        alignas(16) int32_t i[4], j[4], k[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(i), _mm_cvttps_epi32(x_floor));
+        _mm_store_si128(reinterpret_cast<__m128i*>(j), _mm_cvttps_epi32(y_floor));
+        _mm_store_si128(reinterpret_cast<__m128i*>(k), _mm_cvttps_epi32(z_floor));
+
+        // Permutations of both cells along each axis, which the eight corners combine.
+        std::array<std::array<uint32_t, 4>, 2> x_hashes, y_hashes, z_hashes;
+        for (size_t d = 0; d < 2; ++d)
+        {
+            for (size_t l = 0; l < 4; ++l)
+            {
+                x_hashes[d][l] = this->x_permutations[(i[l] + d) & 255];
+                y_hashes[d][l] = this->y_permutations[(j[l] + d) & 255];
+                z_hashes[d][l] = this->z_permutations[(k[l] + d) & 255];
+            }
+        }
+
+        const __m128 one = _mm_set1_ps(1.f);
+        __m128 accumulated = _mm_setzero_ps();
+        for (size_t it = 0; it < 8; ++it)
+        {
+            const size_t di = (it & 4) >> 2;
+            const size_t dj = (it & 2) >> 1;
+            const size_t dk = (it & 1) >> 0;
+
+            alignas(16) float gradient_x[4], gradient_y[4], gradient_z[4];
+            for (size_t l = 0; l < 4; ++l)
+            {
+                const glm::vec3& gradient = this->random_vectors[x_hashes[di][l] ^ y_hashes[dj][l] ^ z_hashes[dk][l]];
+                gradient_x[l] = gradient.x;
+                gradient_y[l] = gradient.y;
+                gradient_z[l] = gradient.z;
+            }
+
+            const __m128 dot = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(_mm_load_ps(gradient_x), _mm_sub_ps(u, _mm_set1_ps(float(di)))),
+                _mm_mul_ps(_mm_load_ps(gradient_y), _mm_sub_ps(v, _mm_set1_ps(float(dj))))),
+                _mm_mul_ps(_mm_load_ps(gradient_z), _mm_sub_ps(w, _mm_set1_ps(float(dk)))));
+            const __m128 weight = _mm_mul_ps(_mm_mul_ps(
+                di ? uu : _mm_sub_ps(one, uu),
+                dj ? vv : _mm_sub_ps(one, vv)),
+                dk ? ww : _mm_sub_ps(one, ww));
+            accumulated = _mm_add_ps(accumulated, _mm_mul_ps(weight, dot));
+        }
+
+        alignas(16) float values[4];
+        _mm_store_ps(values, accumulated);
+        std::copy_n(values, lane_count, out_values + first);
+    }
+}
+
+#else
+
+void perlin::noise(const glm::vec3* in_points, const size_t in_count, float* out_values) const
+{
+    for (size_t i = 0; i < in_count; ++i)
+    {
+        out_values[i] = this->noise(in_points[i]);
+    }
+}
+
+#endif
\ No newline at end of file
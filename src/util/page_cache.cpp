@@ -0,0 +1,230 @@
+#include <util/page_cache.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+static uint64_t page_key(const uint32_t in_source, const uint32_t in_page_index)
+{
+    return (uint64_t(in_source) << 32) | in_page_index;
+}
+
+// Threads tell caches apart by id, since a new cache can take the address of a destroyed one.
+static uint64_t next_cache_id()
+{
+    static std::atomic<uint64_t> last_id = 0;
+    return last_id.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+page_cache::page_cache(const size_t byte_budget)
+    : id(next_cache_id())
+    , byte_budget(byte_budget)
+{
+}
+
+uint32_t page_cache::add_source(const std::filesystem::path& in_path, const uint64_t in_offset, const uint64_t in_size,
+    const size_t in_page_size)
+{
+    using namespace std::literals;
+    auto added = std::make_unique<source>();
+    added->file.open(in_path, std::ios::binary);
+    if (!added->file)
+    {
+        throw std::runtime_error("Paged file '"s + in_path.string() + "' could not be opened.");
+    }
+    added->offset = in_offset;
+    added->size = in_size;
+    added->page_size = in_page_size;
+    this->sources.push_back(std::move(added));
+    return this->sources.size() - 1;
+}
+
+void page_cache::read(const uint32_t in_source, uint64_t in_offset, size_t in_size, uint8_t* out_bytes)
+{
+    source& from = *this->sources[in_source];
+    recent_pages& recent = this->recent_pages_of_this_thread();
+    while (in_size > 0)
+    {
+        const uint32_t page_index = uint32_t(in_offset / from.page_size);
+        const size_t offset_in_page = size_t(in_offset % from.page_size);
+        const size_t read_size = std::min(in_size, from.page_size - offset_in_page);
+        const page& found = this->find_page(recent, from, in_source, page_index);
+        std::memcpy(out_bytes, found.bytes.data() + offset_in_page, read_size);
+
+        in_offset += read_size;
+        in_size -= read_size;
+        out_bytes += read_size;
+    }
+}
+
+page_cache::recent_pages& page_cache::recent_pages_of_this_thread()
+{
+    thread_local recent_pages recent;
+    if (recent.cache_id != this->id)
+    {
+        recent = recent_pages{};
+        recent.cache_id = this->id;
+        std::lock_guard lock{ this->thread_counts_mtx };
+        recent.counts = this->all_thread_counts.emplace_back(std::make_unique<thread_counts>()).get();
+    }
+    return recent;
+}
+
+static void count_one(std::atomic<uint64_t>& inout_count)
+{
+    inout_count.store(inout_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+const page_cache::page& page_cache::find_page(recent_pages& inout_recent, source& inout_source, const uint32_t in_source,
+    const uint32_t in_page_index)
+{
+    const uint64_t key = page_key(in_source, in_page_index);
+    for (size_t i = 0; i < recent_page_count; ++i)
+    {
+        if (inout_recent.keys[i] == key && inout_recent.pages[i])
+        {
+            count_one(inout_recent.counts->hits);
+            return *inout_recent.pages[i];
+        }
+    }
+
+    std::shared_ptr<page> found;
+    {
+        shard& it_shard = this->shard_of(key);
+        std::shared_lock lock{ it_shard.mtx };
+        if (const auto resident = it_shard.pages.find(key); resident != it_shard.pages.end())
+        {
+            resident->second->referenced.store(true, std::memory_order_relaxed);
+            found = resident->second;
+        }
+    }
+
+    if (found)
+    {
+        count_one(inout_recent.counts->hits);
+    }
+    else
+    {
+        count_one(inout_recent.counts->misses);
+        auto loaded = std::make_shared<page>();
+        loaded->bytes = this->load_page(inout_source, in_page_index);
+        found = this->insert_page(key, std::move(loaded));
+    }
+
+    const size_t slot = inout_recent.next;
+    inout_recent.next = (slot + 1) % recent_page_count;
+    inout_recent.keys[slot] = key;
+    inout_recent.pages[slot] = std::move(found);
+    return *inout_recent.pages[slot];
+}
+
+page_cache::statistics page_cache::stats() const
+{
+    uint64_t hits = 0, misses = 0;
+    {
+        std::lock_guard lock{ this->thread_counts_mtx };
+        for (const std::unique_ptr<thread_counts>& it_counts : this->all_thread_counts)
+        {
+            hits += it_counts->hits.load(std::memory_order_relaxed);
+            misses += it_counts->misses.load(std::memory_order_relaxed);
+        }
+    }
+
+    std::lock_guard lock{ this->clock_mtx };
+    return statistics{
+        hits,
+        misses,
+        this->eviction_count.load(),
+        this->resident_bytes,
+        this->byte_budget,
+    };
+}
+
+void page_cache::print_stats() const
+{
+    const statistics current = this->stats();
+    const uint64_t lookups = current.hits + current.misses;
+    std::cout
+        << "Texture pages: " << current.hits << " hits, " << current.misses << " misses ("
+        << std::fixed << std::setprecision(2) << (lookups > 0 ? 100.f * float(current.hits) / float(lookups) : 0.f)
+        << "% hit rate), " << current.evictions << " evictions, "
+        << (current.resident_bytes >> 20) << "/" << (current.byte_budget >> 20) << " MiB resident." << std::endl;
+}
+
+page_cache::shard& page_cache::shard_of(const uint64_t in_key)
+{
+    return this->shards[(in_key * 0x9E3779B97F4A7C15ull) >> 58];
+}
+
+std::vector<uint8_t> page_cache::load_page(source& inout_source, const uint32_t in_page_index)
+{
+    using namespace std::literals;
+    const uint64_t page_offset = uint64_t(in_page_index) * inout_source.page_size;
+    std::vector<uint8_t> bytes(size_t(std::min<uint64_t>(inout_source.page_size, inout_source.size - page_offset)));
+
+    std::lock_guard lock{ inout_source.file_mtx };
+    inout_source.file.seekg(std::streamoff(inout_source.offset + page_offset));
+    inout_source.file.read(reinterpret_cast<char*>(bytes.data()), std::streamsize(bytes.size()));
+    if (!inout_source.file)
+    {
+        throw std::runtime_error("Page "s + std::to_string(in_page_index) + " could not be read.");
+    }
+    return bytes;
+}
+
+std::shared_ptr<page_cache::page> page_cache::insert_page(const uint64_t in_key, std::shared_ptr<page>&& in_page)
+{
+    const size_t page_size = in_page->bytes.size();
+    std::shared_ptr<page> inserted;
+    {
+        shard& it_shard = this->shard_of(in_key);
+        std::unique_lock lock{ it_shard.mtx };
+        auto [found, is_inserted] = it_shard.pages.try_emplace(in_key, std::move(in_page));
+        if (!is_inserted)
+        {
+            // Another thread loaded the same page meanwhile.
+            return found->second;
+        }
+        inserted = found->second;
+    }
+
+    {
+        std::lock_guard lock{ this->clock_mtx };
+        this->clock.push_back(in_key);
+        this->resident_bytes += page_size;
+    }
+    this->evict_over_budget();
+    return inserted;
+}
+
+void page_cache::evict_over_budget()
+{
+    std::lock_guard lock{ this->clock_mtx };
+    while (this->resident_bytes > this->byte_budget && !this->clock.empty())
+    {
+        if (this->clock_hand >= this->clock.size())
+        {
+            this->clock_hand = 0;
+        }
+
+        const uint64_t key = this->clock[this->clock_hand];
+        shard& it_shard = this->shard_of(key);
+        std::unique_lock shard_lock{ it_shard.mtx };
+        const auto found = it_shard.pages.find(key);
+
+        // Pages read since the hand last passed get a second chance.
+        if (found->second->referenced.exchange(false, std::memory_order_relaxed))
+        {
+            ++this->clock_hand;
+            continue;
+        }
+
+        this->resident_bytes -= found->second->bytes.size();
+        it_shard.pages.erase(found);
+        this->clock[this->clock_hand] = this->clock.back();
+        this->clock.pop_back();
+        this->eviction_count.fetch_add(1, std::memory_order_relaxed);
+    }
+}
\ No newline at end of file